@@ -0,0 +1,128 @@
+// 请求解析的微基准：HttpConn直接解析内存中的固定请求并生成响应，不经过socket
+// 走io_uring后端使用的接口（appendReadData/prepareResponse/finishResponse），文件由缓存命中
+// Usage: parse_bench [docRoot] [iterations]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+
+#include "../src/http/http_conn.h"
+#include "../src/http/http_scanner.h"
+
+struct BenchCase
+{
+    const char *name;
+    const char *request;
+    int requestCount;       // Requests in the text, more than one when pipelined
+};
+
+static const char BROWSER_REQUEST[] =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: localhost:9006\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:124.0) Gecko/20100101 Firefox/124.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: identity\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: session=4f6c1b2e9a7d4c3b8e5f0a1d2c3b4a59; theme=dark; lang=en\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "\r\n";
+
+static const char MINIMAL_REQUEST[] = "GET /index.html HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n";
+
+static long nowNanoseconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+// One request (or pipelined batch) in, its responses built and released; false when it did not parse
+static bool runOnce(HttpConn &conn, const std::string &request)
+{
+    if (!conn.appendReadData(request.data(), (int)request.size()))
+        return false;
+    if (conn.prepareResponse(nullptr) == HttpConn::NO_REQUEST)
+        return false;
+    return conn.finishResponse();
+}
+
+// Bytes queued for the responses of one run, to check that every version answers the same way
+static long responseBytes(HttpConn &conn, const std::string &request)
+{
+    long bytes = 0;
+    if (conn.appendReadData(request.data(), (int)request.size()) && conn.prepareResponse(nullptr) != HttpConn::NO_REQUEST)
+    {
+        int iovCount;
+        struct iovec *iov = conn.getWriteIov(iovCount);
+        for (int i = 0; i < iovCount; ++i)
+            bytes += iov[i].iov_len;
+    }
+    conn.finishResponse();
+    return bytes;
+}
+
+// Best of several rounds, in nanoseconds per request
+static double measure(HttpConn &conn, const BenchCase &benchCase, long iterations, long &bytes)
+{
+    std::string request;
+    for (int i = 0; i < benchCase.requestCount; ++i)
+        request += benchCase.request;
+    bytes = responseBytes(conn, request);
+
+    for (long i = 0; i < iterations / 10; ++i)
+    {
+        if (!runOnce(conn, request))
+        {
+            fprintf(stderr, "%s: request not answered\n", benchCase.name);
+            exit(1);
+        }
+    }
+
+    double best = 0;
+    for (int round = 0; round < 5; ++round)
+    {
+        long start = nowNanoseconds();
+        for (long i = 0; i < iterations; ++i)
+            runOnce(conn, request);
+        double perRequest = (double)(nowNanoseconds() - start) / iterations / benchCase.requestCount;
+        if (round == 0 || perRequest < best)
+            best = perRequest;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *docRoot = argc > 1 ? argv[1] : "./static";
+    long iterations = argc > 2 ? atol(argv[2]) : 200000;
+
+    // Logging stays closed (logStatus 1); the cache keeps file I/O out of the loop
+    FileCache::getInstance()->init(docRoot, 16 << 20, 0, 1);
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    std::string root(docRoot);
+    HttpConn conn;
+    conn.init(-1, -1, address, &root[0], 0, 1, 64 * 1024, 0, 0, "", 0, 5, 0);
+
+    const BenchCase cases[] = {
+        {"minimal", MINIMAL_REQUEST, 1},
+        {"browser", BROWSER_REQUEST, 1},
+        {"browser x8 pipelined", BROWSER_REQUEST, 8},
+    };
+
+    printf("scanner: %s, %ld iterations\n", scannerName(), iterations);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+    {
+        long bytes;
+        double perRequest = measure(conn, cases[i], iterations, bytes);
+        printf("%-22s %8.1f ns/request  (%ld response bytes)\n", cases[i].name, perRequest, bytes);
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+// 线程池任务队列的微基准：同样数量的生产者和消费者线程，比较MpmcQueue与原来的
+// 互斥锁+信号量链表队列的入队/出队吞吐
+// Usage: queue_bench [items] [capacity]
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <list>
+
+#include "../src/lock/locker.h"
+#include "../src/threadpool/mpmc_queue.h"
+
+// The thread pool's queue before MpmcQueue: a list behind one mutex, a semaphore counting the entries
+template <typename T>
+class LockedQueue
+{
+public:
+    explicit LockedQueue(size_t capacity) : m_capacity(capacity)
+    {
+    }
+
+    bool push(const T &value)
+    {
+        m_locker.lock();
+        if (m_list.size() >= m_capacity)
+        {
+            m_locker.unlock();
+            return false;
+        }
+        m_list.push_back(value);
+        m_locker.unlock();
+        m_count.post();
+        return true;
+    }
+
+    T pop()
+    {
+        while (true)
+        {
+            m_count.wait();
+            m_locker.lock();
+            if (m_list.empty())
+            {
+                m_locker.unlock();
+                continue;
+            }
+            T value = m_list.front();
+            m_list.pop_front();
+            m_locker.unlock();
+            return value;
+        }
+    }
+
+private:
+    size_t m_capacity;
+    std::list<T> m_list;
+    Locker m_locker;
+    Semaphore m_count;
+};
+
+template <typename Queue>
+struct BenchThread
+{
+    Queue *queue;
+    long first;             // Producers push first+1 .. first+count
+    long count;
+    uint64_t sum;           // Consumers add up what they popped
+    pthread_t thread;
+};
+
+template <typename Queue>
+static void *producer(void *arg)
+{
+    BenchThread<Queue> *self = static_cast<BenchThread<Queue> *>(arg);
+    for (long i = self->first + 1; i <= self->first + self->count; ++i)
+    {
+        // Full: the event loop would reject the task, here the producer waits for room
+        while (!self->queue->push(reinterpret_cast<int *>(i)))
+            sched_yield();
+    }
+    return nullptr;
+}
+
+template <typename Queue>
+static void *consumer(void *arg)
+{
+    BenchThread<Queue> *self = static_cast<BenchThread<Queue> *>(arg);
+    uint64_t sum = 0;
+    for (long i = 0; i < self->count; ++i)
+        sum += reinterpret_cast<uintptr_t>(self->queue->pop());
+    self->sum = sum;
+    return nullptr;
+}
+
+static long nowNanoseconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+// Millions of items through the queue per second, pairs producers and as many consumers
+template <typename Queue>
+static double measure(int pairs, long items, size_t capacity)
+{
+    Queue queue(capacity);
+    long perThread = items / pairs;
+    BenchThread<Queue> *producers = new BenchThread<Queue>[pairs];
+    BenchThread<Queue> *consumers = new BenchThread<Queue>[pairs];
+
+    long start = nowNanoseconds();
+    for (int i = 0; i < pairs; ++i)
+    {
+        consumers[i] = BenchThread<Queue>{&queue, 0, perThread, 0, 0};
+        producers[i] = BenchThread<Queue>{&queue, i * perThread, perThread, 0, 0};
+        if (pthread_create(&consumers[i].thread, nullptr, consumer<Queue>, &consumers[i]) != 0 ||
+            pthread_create(&producers[i].thread, nullptr, producer<Queue>, &producers[i]) != 0)
+        {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    uint64_t sum = 0;
+    for (int i = 0; i < pairs; ++i)
+    {
+        pthread_join(producers[i].thread, nullptr);
+        pthread_join(consumers[i].thread, nullptr);
+        sum += consumers[i].sum;
+    }
+    long elapsed = nowNanoseconds() - start;
+
+    // Every value popped exactly once
+    uint64_t total = (uint64_t)perThread * pairs;
+    if (sum != total * (total + 1) / 2)
+    {
+        fprintf(stderr, "%d pairs: checksum mismatch\n", pairs);
+        exit(1);
+    }
+    delete[] producers;
+    delete[] consumers;
+    return (double)total * 1000.0 / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    long items = argc > 1 ? atol(argv[1]) : 2000000;
+    size_t capacity = argc > 2 ? atol(argv[2]) : 10000;     // The server's default max requests
+
+    printf("%ld items, capacity %zu, producers = consumers = threads\n", items, capacity);
+    printf("%8s %16s %16s\n", "threads", "locked Mops/s", "mpmc Mops/s");
+    const int threadCounts[] = {1, 2, 4, 8, 16, 32, 64};
+    for (size_t i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); ++i)
+    {
+        int pairs = threadCounts[i];
+        double locked = measure<LockedQueue<int *> >(pairs, items, capacity);
+        double mpmc = measure<MpmcQueue<int *> >(pairs, items, capacity);
+        printf("%8d %16.2f %16.2f\n", pairs, locked, mpmc);
+    }
+    return 0;
+}
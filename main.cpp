@@ -17,12 +17,25 @@ int main(int argc, char *argv[])
     // Initialize the server
     server.init(config.port, username, password, databaseName, config.logWriteMethod, 
                 config.enableLinger, config.triggerMode, config.sqlConnectionPoolSize, 
-                config.threadPoolSize, config.logStatus, config.actorModel);
+                config.threadPoolSize, config.logStatus, config.actorModel,
+                config.subReactorCount, config.ioBackend, config.maxRequestSize, config.sendFile,
+                config.fileCacheSize, config.cacheMaxAge, config.maxUploadSize, config.uploadDirectory,
+                config.keepAliveTimeout, config.maxKeepAliveRequests, config.scheduleMode,
+                config.staticQueueLimit, config.blockingThreads, config.blockingQueueLimit);
 
 
+    // Route SIGTERM/SIGHUP through signalfd (before any thread is started)
+    server.setupSignals();
+
     // Setup logging
     server.setupLogging();
 
+    // Setup the static file cache
+    server.setupFileCache();
+
+    // Create the upload staging directory
+    server.setupUploads();
+
     // Setup database connection pool
     server.setupDatabaseConnectionPool();
 
@@ -32,6 +45,9 @@ int main(int argc, char *argv[])
     // Configure trigger mode
     server.configureTriggerMode();
 
+    // Start sub-reactors (main/sub-reactor mode only)
+    server.setupSubReactors();
+
     // Start listening for events
     server.startListening();
 
@@ -0,0 +1,494 @@
+#include "file_cache.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../log/log.h"
+#include "../http/http_headers.h"
+
+// Smaller files gain too little from compression to be worth a second entry
+static const long MIN_COMPRESS_SIZE = 256;
+// The variant is built on the request worker of the first miss. zlib's default level compresses a few times
+// faster than Z_BEST_COMPRESSION for a few percent more bytes; precompressed siblings can use any level
+static const int GZIP_LEVEL = 6;
+
+// Changes that make a cached mapping, fd or stat stale
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                                   IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+FileCache::FileCache()
+    : m_enabled(false)
+    , m_capacity(0)
+    , m_maxFileSize(0)
+    , m_size(0)
+    , m_cacheMaxAge(0)
+    , m_logStatus(0)
+    , m_inotifyFd(-1)
+{
+}
+
+FileCache::~FileCache()
+{
+    for (std::list<CachedFile *>::iterator it = m_lru.begin(); it != m_lru.end(); ++it)
+    {
+        if ((*it)->refCount == 0)
+            destroy(*it);
+    }
+    // m_inotifyFd is left to the process exit: closing it would wake the watch thread into its
+    // error path while other singletons (the log) are already being torn down
+}
+
+FileCache *FileCache::getInstance()
+{
+    static FileCache instance;
+    return &instance;
+}
+
+void FileCache::init(const char *docRoot, size_t capacity, int cacheMaxAge, int logStatus)
+{
+    m_docRoot = docRoot;
+    m_cacheMaxAge = cacheMaxAge;
+    m_logStatus = logStatus;
+    if (capacity == 0)
+        return;
+
+    // Without invalidation the cache could serve stale files forever, so it stays off
+    m_inotifyFd = inotify_init1(IN_CLOEXEC);
+    if (m_inotifyFd == -1)
+    {
+        LOG_ERROR(m_logStatus, "inotify_init1 failed, file cache disabled: %s", strerror(errno));
+        return;
+    }
+    addWatch(docRoot);
+
+    m_capacity = capacity;
+    m_maxFileSize = capacity / 4;   // Keep one large file from flushing everything else
+    m_enabled = true;
+
+    pthread_t tid;
+    pthread_create(&tid, nullptr, watchThread, this);
+    pthread_detach(tid);
+}
+
+// 只缓存docroot下规范的路径，避免同一文件以不同的键缓存而逃过inotify失效
+// docroot本身可以含有".."，inotify报告的路径以同样的前缀拼出
+bool FileCache::isCanonicalPath(const char *path) const
+{
+    if (strncmp(path, m_docRoot.c_str(), m_docRoot.size()) != 0)
+        return false;
+    path += m_docRoot.size();
+    return strstr(path, "//") == nullptr && strstr(path, "/.") == nullptr;
+}
+
+// 编码变体的键：路径后接'\0'和编码名，不会与任何真实路径冲突
+static std::string variantKey(const std::string &path, int encoding)
+{
+    std::string key(path);
+    key.push_back('\0');
+    key.append(encodingName(encoding));
+    return key;
+}
+
+CachedFile *FileCache::acquire(const char *path)
+{
+    if (!m_enabled || !isCanonicalPath(path))
+        return nullptr;
+    return lookup(path, path, ENCODING_IDENTITY);
+}
+
+CachedFile *FileCache::acquireEncoded(const char *path, int encodings)
+{
+    if (!m_enabled || !isCanonicalPath(path))
+        return nullptr;
+
+    // Brotli is preferred, it compresses text noticeably better than gzip
+    static const int preference[] = {ENCODING_BR, ENCODING_GZIP};
+    for (size_t i = 0; i < sizeof(preference) / sizeof(preference[0]); ++i)
+    {
+        if (!(encodings & preference[i]))
+            continue;
+        CachedFile *file = lookup(variantKey(path, preference[i]), path, preference[i]);
+        if (file)
+            return file;
+    }
+    return nullptr;
+}
+
+CachedFile *FileCache::lookup(const std::string &key, const char *path, int encoding)
+{
+    m_lock.lock();
+    std::unordered_map<std::string, CachedFile *>::iterator it = m_files.find(key);
+    while (it != m_files.end() && it->second->loading)
+    {
+        // Another thread is loading this file: wait for it instead of repeating the syscalls
+        m_loaded.wait(m_lock.get());
+        it = m_files.find(key);
+    }
+    if (it != m_files.end())
+    {
+        CachedFile *file = it->second;
+        // Known not to exist: no syscall until inotify reports it created
+        if (file->missing)
+        {
+            m_lock.unlock();
+            return nullptr;
+        }
+        ++file->refCount;
+        m_lru.splice(m_lru.begin(), m_lru, file->lruPosition);
+        m_lock.unlock();
+        return file;
+    }
+
+    // Miss: publish a placeholder so concurrent misses for the same path coalesce on it
+    CachedFile *file = new CachedFile();
+    file->key = key;
+    file->path = path;
+    file->encoding = encoding;
+    file->address = nullptr;
+    file->fd = -1;
+    file->missing = false;
+    file->compressible = false;
+    file->refCount = 1;
+    file->loading = true;
+    file->cached = true;
+    m_lru.push_front(file);
+    file->lruPosition = m_lru.begin();
+    m_files[key] = file;
+    m_lock.unlock();
+
+    bool loaded = load(file);
+
+    m_lock.lock();
+    file->loading = false;
+    // Invalidated while loading: what was read may already be stale
+    if (loaded && file->cached)
+    {
+        if (!file->missing)
+            m_size += file->fileStat.st_size;
+        evict();
+        if (file->missing)
+        {
+            --file->refCount;
+            loaded = false;
+        }
+    }
+    else
+    {
+        if (file->cached)
+            unlink(file);
+        --file->refCount;
+        loaded = false;
+    }
+    m_loaded.broadcast();
+    m_lock.unlock();
+
+    if (!loaded)
+    {
+        if (file->refCount == 0 && !file->cached)
+            destroy(file);
+        return nullptr;
+    }
+    return file;
+}
+
+void FileCache::release(CachedFile *file)
+{
+    m_lock.lock();
+    bool dead = (--file->refCount == 0) && !file->cached;
+    m_lock.unlock();
+    if (dead)
+        destroy(file);
+}
+
+bool FileCache::load(CachedFile *file)
+{
+    int result;
+    if (file->encoding == ENCODING_IDENTITY)
+    {
+        result = openFile(file, file->path.c_str());
+    }
+    else
+    {
+        // A precompressed sibling wins; without one only gzip is produced here
+        std::string sibling = file->path + encodingExtension(file->encoding);
+        result = openFile(file, sibling.c_str());
+        if (result == 0 && file->encoding == ENCODING_GZIP && compress(file))
+            result = 1;
+    }
+    if (result < 0)
+        return false;
+    if (result == 0)
+    {
+        file->missing = true;
+        return true;
+    }
+
+    file->compressible = isCompressible(mimeType(file->path.c_str()));
+    char headers[512];
+    int length = formatFileHeaders(file->path.c_str(), file->fileStat, file->encoding, m_cacheMaxAge,
+                                   headers, sizeof(headers), file->typeOffset, file->validatorOffset);
+    if (length < 0)
+        return false;
+    file->headers.assign(headers, length);
+    char etag[48];
+    int etagLength = formatEntityTag(file->fileStat, etag, sizeof(etag));
+    file->etag.assign(etag, etagLength);
+    return true;
+}
+
+// 打开并映射文件；返回1成功，0文件不存在（可缓存为负项），-1其他不缓存的情况
+int FileCache::openFile(CachedFile *file, const char *path)
+{
+    if (stat(path, &file->fileStat) < 0)
+        return (errno == ENOENT || errno == ENOTDIR) && file->encoding != ENCODING_IDENTITY ? 0 : -1;
+    // Anything unusual keeps the uncached path and its error responses
+    if (!S_ISREG(file->fileStat.st_mode) || !(file->fileStat.st_mode & S_IROTH))
+        return -1;
+    if (file->fileStat.st_size == 0 || (size_t)file->fileStat.st_size > m_maxFileSize)
+        return -1;
+
+    file->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (file->fd < 0)
+        return -1;
+    void *address = mmap(nullptr, file->fileStat.st_size, PROT_READ, MAP_SHARED, file->fd, 0);
+    if (address == MAP_FAILED)
+    {
+        close(file->fd);
+        file->fd = -1;
+        return -1;
+    }
+    file->address = static_cast<char *>(address);
+    return 1;
+}
+
+// gzip压缩原文件，结果保存在内存中（fd为-1）；压缩后不变小则不保存
+bool FileCache::compress(CachedFile *file)
+{
+    CachedFile source;
+    source.encoding = ENCODING_IDENTITY;
+    source.address = nullptr;
+    source.fd = -1;
+    if (openFile(&source, file->path.c_str()) != 1)
+        return false;
+
+    bool compressed = false;
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // windowBits 15 + 16 writes a gzip header and trailer instead of the zlib ones
+    if (source.fileStat.st_size >= MIN_COMPRESS_SIZE &&
+        deflateInit2(&stream, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+    {
+        uLong bound = deflateBound(&stream, source.fileStat.st_size);
+        char *buffer = static_cast<char *>(malloc(bound));
+        stream.next_in = reinterpret_cast<Bytef *>(source.address);
+        stream.avail_in = source.fileStat.st_size;
+        stream.next_out = reinterpret_cast<Bytef *>(buffer);
+        stream.avail_out = bound;
+        if (buffer && deflate(&stream, Z_FINISH) == Z_STREAM_END && (long)stream.total_out < source.fileStat.st_size)
+        {
+            file->address = buffer;
+            file->fileStat = source.fileStat;
+            file->fileStat.st_size = stream.total_out;
+            compressed = true;
+        }
+        else
+        {
+            free(buffer);
+        }
+        deflateEnd(&stream);
+    }
+
+    munmap(source.address, source.fileStat.st_size);
+    close(source.fd);
+    return compressed;
+}
+
+// 从索引和LRU链表中摘除；仍在使用的项由最后一个release销毁
+void FileCache::unlink(CachedFile *file)
+{
+    m_files.erase(file->key);
+    m_lru.erase(file->lruPosition);
+    if (!file->loading && !file->missing)
+        m_size -= file->fileStat.st_size;
+    file->cached = false;
+}
+
+void FileCache::evict()
+{
+    std::list<CachedFile *>::iterator it = m_lru.end();
+    while ((m_size > m_capacity || m_files.size() > (size_t)MAX_ENTRIES) && it != m_lru.begin())
+    {
+        CachedFile *file = *--it;
+        if (file->loading)
+            continue;
+        // Step back over the victim before its node is erased
+        ++it;
+        unlink(file);
+        if (file->refCount == 0)
+            destroy(file);
+    }
+}
+
+void FileCache::destroy(CachedFile *file)
+{
+    if (file->address && file->fd == -1)
+        free(file->address);
+    else if (file->address)
+        munmap(file->address, file->fileStat.st_size);
+    if (file->fd != -1)
+        close(file->fd);
+    delete file;
+}
+
+// 一个文件的变化也使它的编码变体失效；.br/.gz兄弟文件的变化使对应的变体失效
+void FileCache::invalidateVariants(const std::string &path)
+{
+    invalidate(path);
+    invalidate(variantKey(path, ENCODING_BR));
+    invalidate(variantKey(path, ENCODING_GZIP));
+
+    static const int encodings[] = {ENCODING_BR, ENCODING_GZIP};
+    for (size_t i = 0; i < sizeof(encodings) / sizeof(encodings[0]); ++i)
+    {
+        const char *extension = encodingExtension(encodings[i]);
+        size_t length = strlen(extension);
+        if (path.size() > length && path.compare(path.size() - length, length, extension) == 0)
+            invalidate(variantKey(path.substr(0, path.size() - length), encodings[i]));
+    }
+}
+
+void FileCache::invalidate(const std::string &path)
+{
+    m_lock.lock();
+    CachedFile *file = nullptr;
+    std::unordered_map<std::string, CachedFile *>::iterator it = m_files.find(path);
+    bool found = it != m_files.end();
+    if (found)
+    {
+        file = it->second;
+        unlink(file);
+        if (file->refCount != 0)
+            file = nullptr;
+    }
+    m_lock.unlock();
+
+    if (file)
+        destroy(file);
+    if (found)
+        LOG_INFO(m_logStatus, "file cache: invalidated %s", path.c_str());
+}
+
+void FileCache::invalidateAll()
+{
+    std::list<CachedFile *> dead;
+    m_lock.lock();
+    while (!m_lru.empty())
+    {
+        CachedFile *file = m_lru.front();
+        unlink(file);
+        if (file->refCount == 0)
+            dead.push_back(file);
+    }
+    m_lock.unlock();
+
+    for (std::list<CachedFile *>::iterator it = dead.begin(); it != dead.end(); ++it)
+        destroy(*it);
+    LOG_INFO(m_logStatus, "file cache: invalidated all entries");
+}
+
+// 递归监视docroot下的所有目录
+void FileCache::addWatch(const std::string &directory)
+{
+    int wd = inotify_add_watch(m_inotifyFd, directory.c_str(), WATCH_MASK | IN_ONLYDIR);
+    if (wd < 0)
+    {
+        LOG_ERROR(m_logStatus, "inotify_add_watch %s failed: %s", directory.c_str(), strerror(errno));
+        return;
+    }
+    m_watches[wd] = directory;
+
+    DIR *dir = opendir(directory.c_str());
+    if (!dir)
+        return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        if (entry->d_type != DT_DIR || strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        addWatch(directory + "/" + entry->d_name);
+    }
+    closedir(dir);
+}
+
+void *FileCache::watchThread(void *args)
+{
+    static_cast<FileCache *>(args)->watch();
+    return nullptr;
+}
+
+void FileCache::watch()
+{
+    alignas(struct inotify_event) char buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+    while (true)
+    {
+        ssize_t length = read(m_inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0)
+        {
+            if (length < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (char *p = buffer; p < buffer + length; )
+        {
+            struct inotify_event *event = reinterpret_cast<struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                // Events were dropped, nothing cached can be trusted
+                invalidateAll();
+                continue;
+            }
+            if (event->mask & IN_IGNORED)
+            {
+                m_watches.erase(event->wd);
+                continue;
+            }
+
+            std::map<int, std::string>::iterator watch = m_watches.find(event->wd);
+            if (watch == m_watches.end())
+                continue;
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+            {
+                invalidateAll();
+                continue;
+            }
+            if (event->len == 0)
+                continue;
+
+            std::string path = watch->second + "/" + event->name;
+            if (event->mask & IN_ISDIR)
+            {
+                // A directory appeared or moved: watch it, and drop entries that may live under a moved one
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    addWatch(path);
+                if (event->mask & (IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE))
+                    invalidateAll();
+                continue;
+            }
+            invalidateVariants(path);
+        }
+    }
+    LOG_ERROR(m_logStatus, "file cache: inotify read failed, cache disabled");
+    m_enabled = false;
+    invalidateAll();
+}
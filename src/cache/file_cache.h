@@ -0,0 +1,100 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <stddef.h>
+#include <atomic>
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include "../lock/locker.h"
+
+// 静态文件缓存中的一项：文件的只读映射、打开的fd和stat信息
+// 由引用计数保护，被淘汰或失效后等最后一个使用者释放时才真正关闭
+// 压缩变体也是单独的一项：来自.br/.gz兄弟文件，或首次请求时用gzip压缩后保存在内存中
+struct CachedFile
+{
+    std::string key;        // The path, plus '\0' and the coding for an encoded variant
+    std::string path;       // The requested file
+    int encoding;           // ContentEncoding of the bytes below
+    struct stat fileStat;   // For an encoded variant st_size is the compressed size
+    char *address;          // Read-only shared mapping, or the compressed bytes when fd is -1
+    int fd;                 // Held open for the sendfile path, -1 for bytes compressed in memory
+    bool missing;           // Negative entry: the file (or sibling) does not exist
+    bool compressible;      // Worth negotiating an encoded variant for
+    std::string headers;    // Precomputed header lines of a 200 response, see formatFileHeaders
+    int typeOffset;         // Where the headers after Content-Length start
+    int validatorOffset;    // Where the validators (the 304 headers) start in headers
+    std::string etag;
+
+    // Guarded by the cache lock
+    int refCount;
+    bool loading;           // A thread is loading the file; others wait instead of loading it again
+    bool cached;            // Still reachable through the map (not evicted or invalidated)
+    std::list<CachedFile *>::iterator lruPosition;
+};
+
+// 按解析后的路径缓存静态文件，所有线程共享
+// 命中时不再有stat/open/mmap，内存超出预算时按LRU淘汰，docroot下的修改通过inotify使缓存失效
+class FileCache
+{
+public:
+    static const int MAX_ENTRIES = 1024;        // Bounds the fds held by the cache
+
+    // 单例模式
+    static FileCache *getInstance();
+
+    // capacity: memory budget in bytes, 0 disables the cache
+    // cacheMaxAge: Cache-Control max-age baked into the precomputed headers
+    void init(const char *docRoot, size_t capacity, int cacheMaxAge, int logStatus);
+
+    // Returns a referenced entry, or nullptr when the file is not cacheable (missing, not a readable
+    // regular file, empty or too large) and the caller should serve it the uncached way
+    CachedFile *acquire(const char *path);
+    // The best encoded variant of path among the accepted codings (see parseAcceptEncoding):
+    // a precompressed sibling, or for gzip the file compressed once and kept in the cache.
+    // nullptr when there is none and the identity entry should be sent.
+    CachedFile *acquireEncoded(const char *path, int encodings);
+    void release(CachedFile *file);
+
+private:
+    FileCache();
+    ~FileCache();
+
+    static void *watchThread(void *args);
+    void watch();
+    void addWatch(const std::string &directory);
+    void invalidateVariants(const std::string &path);
+    void invalidate(const std::string &path);
+    void invalidateAll();
+
+    bool isCanonicalPath(const char *path) const;
+    CachedFile *lookup(const std::string &key, const char *path, int encoding);
+    bool load(CachedFile *file);
+    int openFile(CachedFile *file, const char *path);
+    bool compress(CachedFile *file);
+    void unlink(CachedFile *file);
+    void evict();
+    static void destroy(CachedFile *file);
+
+private:
+    std::atomic<bool> m_enabled;
+    std::string m_docRoot;
+    size_t m_capacity;
+    size_t m_maxFileSize;
+    size_t m_size;
+    int m_cacheMaxAge;
+    int m_logStatus;
+
+    Locker m_lock;
+    CondVar m_loaded;       // Signalled when a coalesced load completes
+    std::unordered_map<std::string, CachedFile *> m_files;
+    std::list<CachedFile *> m_lru;  // Most recently used first
+
+    int m_inotifyFd;
+    std::map<int, std::string> m_watches;   // Watch descriptor -> directory, only touched by the watch thread
+};
+
+#endif
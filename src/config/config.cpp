@@ -10,14 +10,27 @@ Config::Config()
       sqlConnectionPoolSize(8),
       threadPoolSize(8),
       logStatus(0),              // Logging is enabled by default
-      actorModel(0)              // Default proactor
+      actorModel(0),             // Default proactor
+      subReactorCount(0),        // One sub-reactor per core by default
+      ioBackend(0),              // epoll by default
+      maxRequestSize(64 * 1024), // -b takes KB, 64 KB by default
+      sendFile(1),               // sendfile by default
+      fileCacheSize(64 << 20),   // -k takes MB, 64 MB by default
+      cacheMaxAge(0),            // Revalidate with ETag/If-Modified-Since by default
+      maxUploadSize(64L << 20),  // -u takes MB, 64 MB by default
+      keepAliveTimeout(5),
+      maxKeepAliveRequests(100),
+      scheduleMode(0),           // Shared queue by default
+      staticQueueLimit(10000),
+      blockingThreads(2),
+      blockingQueueLimit(256)
 {
 }
 
 void Config::parseArguments(int argc, char* argv[])
 {
     int option;
-    const char *optionString = "p:l:m:o:s:t:c:a:";
+    const char *optionString = "p:l:m:o:s:t:c:a:r:i:b:f:k:e:u:d:w:n:g:q:j:y:";
     while ((option = getopt(argc, argv, optionString)) != -1)
     {
         switch (option)
@@ -46,6 +59,48 @@ void Config::parseArguments(int argc, char* argv[])
         case 'a':
             actorModel = std::atoi(optarg);
             break;
+        case 'r':
+            subReactorCount = std::atoi(optarg);
+            break;
+        case 'i':
+            ioBackend = std::atoi(optarg);
+            break;
+        case 'b':
+            maxRequestSize = std::atoi(optarg) * 1024;
+            break;
+        case 'f':
+            sendFile = std::atoi(optarg);
+            break;
+        case 'k':
+            fileCacheSize = std::atoi(optarg) << 20;
+            break;
+        case 'e':
+            cacheMaxAge = std::atoi(optarg);
+            break;
+        case 'u':
+            maxUploadSize = std::atol(optarg) << 20;
+            break;
+        case 'd':
+            uploadDirectory = optarg;
+            break;
+        case 'w':
+            keepAliveTimeout = std::atoi(optarg);
+            break;
+        case 'n':
+            maxKeepAliveRequests = std::atoi(optarg);
+            break;
+        case 'g':
+            scheduleMode = std::atoi(optarg);
+            break;
+        case 'q':
+            staticQueueLimit = std::atoi(optarg);
+            break;
+        case 'j':
+            blockingThreads = std::atoi(optarg);
+            break;
+        case 'y':
+            blockingQueueLimit = std::atoi(optarg);
+            break;
         default:
             break;
         }
@@ -40,6 +40,48 @@ public:
 
     // Concurrency model selection
     int actorModel;
+
+    // Number of sub-reactors in main/sub-reactor mode (0 = one per core)
+    int subReactorCount;
+
+    // I/O backend: 0 epoll, 1 io_uring
+    int ioBackend;
+
+    // Largest request (line, headers and body) a connection may buffer, in bytes
+    int maxRequestSize;
+
+    // File bodies: 0 mmap + writev, 1 sendfile from a held fd
+    int sendFile;
+
+    // Static file cache budget in bytes, 0 disables it
+    int fileCacheSize;
+
+    // Cache-Control max-age of static files in seconds, 0 makes clients revalidate every time
+    int cacheMaxAge;
+
+    // Largest upload accepted by POST /upload in bytes, 0 disables uploads
+    long maxUploadSize;
+
+    // Staging directory of uploaded files, empty for the default next to the document root
+    std::string uploadDirectory;
+
+    // Seconds an idle persistent connection is kept open between requests
+    int keepAliveTimeout;
+
+    // Requests served on one connection before it is closed, 0 for no limit
+    int maxKeepAliveRequests;
+
+    // Thread pool scheduling: 0 one shared queue, 1 per-worker queues with work stealing
+    int scheduleMode;
+
+    // Request queue limit of the thread pool's static lane
+    int staticQueueLimit;
+
+    // Threads of the lane for database-bound handlers, 0 leaves them in the static lane
+    int blockingThreads;
+
+    // Requests the blocking lane queues before answering 503
+    int blockingQueueLimit;
 };
 
 #endif
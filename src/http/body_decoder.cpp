@@ -0,0 +1,131 @@
+#include "body_decoder.h"
+
+#include <string.h>
+
+// 15 hex digits keep a chunk size below 2^60, no overflow in the arithmetic below
+static const int MAX_SIZE_DIGITS = 15;
+
+void BodyDecoder::startIdentity(long length)
+{
+    m_chunked = false;
+    m_state = length > 0 ? STATE_DATA : STATE_DONE;
+    m_remaining = length;
+    m_sizeDigits = 0;
+    m_received = 0;
+}
+
+void BodyDecoder::skip(long length)
+{
+    m_remaining -= length;
+    m_received += length;
+    if (m_remaining == 0)
+        m_state = STATE_DONE;
+}
+
+void BodyDecoder::startChunked()
+{
+    m_chunked = true;
+    m_state = STATE_SIZE;
+    m_remaining = 0;
+    m_sizeDigits = 0;
+    m_received = 0;
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+BodyDecoder::Status BodyDecoder::decode(char *data, int length, int &consumed, int &produced)
+{
+    int in = 0;
+    int out = 0;
+    while (in < length && m_state != STATE_DONE)
+    {
+        if (m_state == STATE_DATA)
+        {
+            int count = m_remaining < length - in ? (int)m_remaining : length - in;
+            // Framing already skipped leaves a gap: close it so the body is contiguous
+            if (out != in)
+                memmove(data + out, data + in, count);
+            in += count;
+            out += count;
+            m_remaining -= count;
+            m_received += count;
+            if (m_remaining == 0)
+                m_state = m_chunked ? STATE_DATA_CR : STATE_DONE;
+            continue;
+        }
+
+        char c = data[in++];
+        switch (m_state)
+        {
+        case STATE_SIZE:
+        {
+            int digit = hexValue(c);
+            if (digit >= 0)
+            {
+                if (++m_sizeDigits > MAX_SIZE_DIGITS)
+                    return BODY_ERROR;
+                m_remaining = m_remaining * 16 + digit;
+            }
+            else if (m_sizeDigits == 0)
+                return BODY_ERROR;
+            else if (c == ';' || c == ' ' || c == '\t')
+                m_state = STATE_EXTENSION;
+            else if (c == '\r')
+                m_state = STATE_SIZE_LF;
+            else
+                return BODY_ERROR;
+            break;
+        }
+        case STATE_EXTENSION:
+            if (c == '\r')
+                m_state = STATE_SIZE_LF;
+            else if (c == '\n')
+                return BODY_ERROR;
+            break;
+        case STATE_SIZE_LF:
+            if (c != '\n')
+                return BODY_ERROR;
+            m_sizeDigits = 0;
+            // The zero-size chunk ends the data, trailer fields may follow
+            m_state = m_remaining > 0 ? STATE_DATA : STATE_TRAILER;
+            break;
+        case STATE_DATA_CR:
+            if (c != '\r')
+                return BODY_ERROR;
+            m_state = STATE_DATA_LF;
+            break;
+        case STATE_DATA_LF:
+            if (c != '\n')
+                return BODY_ERROR;
+            m_state = STATE_SIZE;
+            break;
+        case STATE_TRAILER:
+            m_state = c == '\r' ? STATE_FINAL_LF : STATE_TRAILER_LINE;
+            break;
+        case STATE_TRAILER_LINE:
+            if (c == '\n')
+                m_state = STATE_TRAILER;
+            break;
+        case STATE_FINAL_LF:
+            if (c != '\n')
+                return BODY_ERROR;
+            m_state = STATE_DONE;
+            break;
+        default:
+            return BODY_ERROR;
+        }
+    }
+
+    consumed = in;
+    produced = out;
+    return m_state == STATE_DONE ? BODY_DONE : BODY_MORE;
+}
@@ -0,0 +1,67 @@
+#ifndef BODY_DECODER_H
+#define BODY_DECODER_H
+
+// 请求正文的增量解码：Content-Length（identity）或 Transfer-Encoding: chunked
+// 数据到达多少解码多少，就地把正文字节移到输入的开头，分块的长度行、CRLF和trailer被去掉
+// 解码器本身只保存几个整数，不缓存任何数据
+class BodyDecoder
+{
+public:
+    enum Status
+    {
+        BODY_MORE,      // All input used, the body continues
+        BODY_DONE,      // The body ended; input after consumed belongs to the next request
+        BODY_ERROR      // Malformed chunked framing
+    };
+
+    BodyDecoder()
+    {
+        startIdentity(0);
+    }
+
+    void startIdentity(long length);
+    void startChunked();
+
+    // Decodes data[0, length). consumed is the input used, produced the body bytes now at data[0, produced)
+    Status decode(char *data, int length, int &consumed, int &produced);
+
+    // Body bytes produced so far
+    long received() const
+    {
+        return m_received;
+    }
+    bool isChunked() const
+    {
+        return m_chunked;
+    }
+    // Identity bodies only: bytes still expected
+    long remaining() const
+    {
+        return m_remaining;
+    }
+    // Identity bodies only: length bytes of the body were taken off the socket without passing through decode()
+    void skip(long length);
+
+private:
+    enum State
+    {
+        STATE_SIZE,             // Hex digits of a chunk size
+        STATE_EXTENSION,        // ";name=value" after the size, ignored
+        STATE_SIZE_LF,
+        STATE_DATA,
+        STATE_DATA_CR,          // CRLF closing a chunk's data
+        STATE_DATA_LF,
+        STATE_TRAILER,          // Start of a trailer line, or the final CRLF
+        STATE_TRAILER_LINE,     // Inside a trailer field, ignored
+        STATE_FINAL_LF,
+        STATE_DONE
+    };
+
+    bool m_chunked;
+    State m_state;
+    long m_remaining;       // Bytes left in the body (identity) or the current chunk
+    int m_sizeDigits;
+    long m_received;
+};
+
+#endif
@@ -1,24 +1,79 @@
 #include "http_conn.h"
+#include "http_headers.h"
+#include "http_scanner.h"
+#include "../metrics/metrics.h"
 
 #include <mysql/mysql.h>
 #include <fstream>
 #include <utility>
 
-// 定义http响应状态信息
-const char *HTTP_STATUS_OK_TITLE = "OK";
-const char *HTTP_STATUS_BAD_REQUEST_TITLE = "Bad Request";
-const char *HTTP_STATUS_BAD_REQUEST_MESSAGE = "Your request has bad syntax or is inherently impossible to satisfy.\n";
-const char *HTTP_STATUS_FORBIDDEN_TITLE = "Forbidden";
-const char *HTTP_STATUS_FORBIDDEN_MESSAGE = "You do not have permission to access the file from this server.\n";
-const char *HTTP_STATUS_NOT_FOUND_TITLE = "Not Found";
-const char *HTTP_STATUS_NOT_FOUND_MESSAGE = "The requested file was not found on this server.\n";
-const char *HTTP_STATUS_INTERNAL_ERROR_TITLE = "Internal Error";
-const char *HTTP_STATUS_INTERNAL_ERROR_MESSAGE = "There was an unusual problem serving the requested file.\n";
+// 定义http响应状态信息，状态行整行在编译时拼好
+struct StatusLine
+{
+    int status;
+    const char *text;
+    int length;
+};
+#define STATUS_LINE(status, title) \
+    { status, "HTTP/1.1 " #status " " title "\r\n", sizeof("HTTP/1.1 " #status " " title "\r\n") - 1 }
+static const StatusLine STATUS_LINES[] = {
+    STATUS_LINE(200, "OK"),
+    STATUS_LINE(206, "Partial Content"),
+    STATUS_LINE(304, "Not Modified"),
+    STATUS_LINE(400, "Bad Request"),
+    STATUS_LINE(403, "Forbidden"),
+    STATUS_LINE(404, "Not Found"),
+    STATUS_LINE(413, "Payload Too Large"),
+    STATUS_LINE(416, "Range Not Satisfiable"),
+    STATUS_LINE(500, "Internal Error"),
+    STATUS_LINE(503, "Service Unavailable"),
+};
+#undef STATUS_LINE
+
+// 错误响应在启动时生成，每次只需复制，中间插入随连接而变的Connection头部
+struct ErrorResponse
+{
+    HttpConn::HttpCode code;
+    int status;
+    const char *message;
+    std::string head;       // Status line, Content-Length and Content-Type
+    std::string tail;       // Blank line and body
+};
+static ErrorResponse ERROR_RESPONSES[] = {
+    {HttpConn::BAD_REQUEST, 400, "Your request has bad syntax or is inherently impossible to satisfy.\n", "", ""},
+    {HttpConn::FORBIDDEN_REQUEST, 403, "You do not have permission to access the file from this server.\n", "", ""},
+    {HttpConn::NO_RESOURCE, 404, "The requested file was not found on this server.\n", "", ""},
+    {HttpConn::PAYLOAD_TOO_LARGE, 413, "The upload is larger than this server accepts.\n", "", ""},
+    {HttpConn::INTERNAL_ERROR, 500, "There was an unusual problem serving the requested file.\n", "", ""},
+    {HttpConn::SERVICE_UNAVAILABLE, 503, "The server is too busy to handle this request, try again later.\n", "", ""},
+};
+
+static const char MULTIPART_BOUNDARY[] = "5e1d0a7c93b24f68";
+const char *UPLOAD_PATH = "/upload";
+const char *METRICS_PATH = "/metrics";
 
 Locker m_lock;
 std::map<std::string, std::string> m_users;
 
-void HttpConn::initMysqlResult(ConnectionPool *connPool)
+void HttpConn::initResponses()
+{
+    for (size_t i = 0; i < sizeof(ERROR_RESPONSES) / sizeof(ERROR_RESPONSES[0]); ++i)
+    {
+        ErrorResponse &response = ERROR_RESPONSES[i];
+        for (size_t j = 0; j < sizeof(STATUS_LINES) / sizeof(STATUS_LINES[0]); ++j)
+        {
+            if (STATUS_LINES[j].status == response.status)
+                response.head.assign(STATUS_LINES[j].text, STATUS_LINES[j].length);
+        }
+        char digits[20];
+        response.head += "Content-Length:";
+        response.head.append(digits, formatDecimal(strlen(response.message), digits));
+        response.head += "\r\nContent-Type:text/html\r\n";
+        response.tail = std::string("\r\n") + response.message;
+    }
+}
+
+void HttpConn::initMysqlResult(ConnectionPool *connPool, int logStatus)
 {
     // Obtain a connection from the connection pool
     MYSQL *mysql = NULL;
@@ -26,7 +81,7 @@ void HttpConn::initMysqlResult(ConnectionPool *connPool)
 
     if (mysql_query(mysql, "SELECT username,passwd FROM user"))
     {
-        LOG_ERROR(m_logStatus, "SELECT error:%s\n", mysql_error(mysql));
+        LOG_ERROR(logStatus, "SELECT error:%s\n", mysql_error(mysql));
         return;
     }
 
@@ -34,7 +89,7 @@ void HttpConn::initMysqlResult(ConnectionPool *connPool)
     MYSQL_RES *result = mysql_store_result(mysql);
     if (!result)
     {
-        LOG_ERROR(m_logStatus, "Failed to store result: %s\n", mysql_error(mysql));
+        LOG_ERROR(logStatus, "Failed to store result: %s\n", mysql_error(mysql));
         return;
     }
 
@@ -100,40 +155,67 @@ void modFd(int epollFd, int fd, int events, int triggerMode)
     epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
 }
 
-int HttpConn::g_userCount = 0;
-int HttpConn::g_epollFd = -1;
+std::atomic<int> HttpConn::g_userCount(0);
+
+HttpConn::HttpConn()
+    : m_readBuffer(nullptr)
+    , m_readCapacity(0)
+    , m_writeBuffer(nullptr)
+    , m_writeCapacity(0)
+    , m_fileAddress(nullptr)
+    , m_fileFd(-1)
+    , m_cachedFile(nullptr)
+    , m_responseCount(0)
+    , m_upload(nullptr)
+{
+}
+
+// 连接槽位归还slab时，交还仍在借用的缓冲区和文件映射
+HttpConn::~HttpConn()
+{
+    releaseUpload();
+    releaseMemory();
+    releaseBuffers();
+}
 
 
-// Close the connection and decrement the user count
+// 只关闭读写方向：fd由事件循环在收到EPOLLRDHUP后关闭，并一同摘除其定时器
+// 在这里直接close会留下仍挂在时间轮上的定时器，fd复用后会误关新连接
 void HttpConn::closeConn(bool realClose)
 {
     if (realClose && (m_socketFd != -1))
     {
-        printf("close %d\n", m_socketFd);
-        removeFd(g_epollFd, m_socketFd);
-        m_socketFd = -1;
-        -- g_userCount;
+        shutdown(m_socketFd, SHUT_RDWR);
+        modFd(m_epollFd, m_socketFd, EPOLLIN, m_triggerMode);
     }
 }
 
 // Initialize the connection, with socket address provided externally
-void HttpConn::init(int socketFd, const sockaddr_in &address, char *docRoot, int triggerMode,
-                     int logStatus, std::string user, std::string password, std::string databaseName)
+// The connection is registered with (and later modified/removed from) the given epoll instance
+void HttpConn::init(int epollFd, int socketFd, const sockaddr_in &address, char *docRoot, int triggerMode,
+                     int logStatus, int maxRequestSize, int sendFile, int cacheMaxAge, const char *uploadDirectory,
+                     long maxUploadSize, int keepAliveTimeout, int maxKeepAliveRequests)
 {
+    m_epollFd = epollFd;
     m_socketFd = socketFd;
     m_address = address;
 
-    addFd(g_epollFd, socketFd, true, triggerMode);
+    // Completion-based backends (io_uring) pass -1 and drive the socket themselves
+    if (m_epollFd != -1)
+        addFd(m_epollFd, socketFd, true, triggerMode);
     ++ g_userCount;
 
     // Potential issues include incorrect root directory, HTTP response format errors, or empty file content
     m_docRoot = docRoot;
     m_triggerMode = triggerMode;
     m_logStatus = logStatus;
-
-    strcpy(m_user, user.c_str());
-    strcpy(m_password, password.c_str());
-    strcpy(m_databaseName, databaseName.c_str());
+    m_maxRequestSize = maxRequestSize;
+    m_sendFile = sendFile;
+    m_cacheMaxAge = cacheMaxAge;
+    m_uploadDirectory = uploadDirectory;
+    m_maxUploadSize = maxUploadSize;
+    m_keepAliveTimeout = keepAliveTimeout;
+    m_maxKeepAliveRequests = maxKeepAliveRequests;
 
     reset();
 }
@@ -142,63 +224,179 @@ void HttpConn::init(int socketFd, const sockaddr_in &address, char *docRoot, int
 // Default CheckState is set to analyze request line state
 void HttpConn::reset()
 {
-    mysql = NULL;
     m_bytesToSend = 0;
     m_bytesHaveSent = 0;
+    m_checkedIndex = 0;
+    m_readIndex = 0;
+    m_writeIndex = 0;
+    m_responseCount = 0;
+    m_requestCount = 0;
+    m_iovCount = 0;
+    m_sendFd = -1;
+    m_bodyFollows = false;
+
+    requestState = 0;
+    lastWorker = -1;
+    queuedAt = 0;
+    taskSequence = 0;
+    inFlight = false;
+    closePending = false;
+
+    releaseBuffers();
+    beginRequest();
+}
+
+// 重置单个请求的解析状态，下一个请求从m_checkedIndex处开始
+void HttpConn::beginRequest()
+{
     m_checkState = CHECK_STATE_REQUEST_LINE;
+    m_http10 = false;
     m_keepAlive = false;
     m_method = GET;
     m_url = nullptr;
     m_version = nullptr;
     m_contentLength = 0;
-    m_host = nullptr;
-    m_startLine = 0;
-    m_checkedIndex = 0;
-    m_readIndex = 0;
-    m_writeIndex = 0;
+    m_headers.clear();
+    m_rangeCount = 0;
+    m_bodyOffset = 0;
+    m_bodyLength = 0;
+    m_requestData = nullptr;
+    m_bodyStart = 0;
+    m_retainBody = false;
+    releaseUpload();
     m_isCgi = 0;
+    m_startLine = m_checkedIndex;
+    m_requestStart = m_checkedIndex;
+    m_realFile[0] = '\0';
+}
 
-    requestState = 0;
-    timerFlag = 0;
-    isImproved = 0;
+// 读缓冲区整体移动后，平移已解析出的指向缓冲区内部的指针
+void HttpConn::rebaseReadPointers(char *oldBase, char *newBase)
+{
+    if (m_url)
+        m_url = newBase + (m_url - oldBase);
+    if (m_version)
+        m_version = newBase + (m_version - oldBase);
+}
+
+// 丢弃已处理完的请求，把未处理的字节（管线化的后续请求）移到缓冲区开头
+void HttpConn::compactReadBuffer()
+{
+    if (m_requestStart >= m_readIndex)
+    {
+        // Nothing of the next request has arrived: give the buffer back while idle
+        m_readIndex = 0;
+        m_checkedIndex = 0;
+        m_startLine = 0;
+        m_requestStart = 0;
+        if (m_readBuffer)
+        {
+            BufferPool::getInstance()->release(m_readBuffer, m_readCapacity);
+            m_readBuffer = nullptr;
+        }
+        return;
+    }
+    if (m_requestStart == 0)
+        return;
 
-    memset(m_readBuffer, '\0', MAX_READ_BUFFER_SIZE);
-    memset(m_writeBuffer, '\0', MAX_WRITE_BUFFER_SIZE);
-    memset(m_realFile, '\0', MAX_FILENAME_LENGTH);
+    long shift = m_requestStart;
+    memmove(m_readBuffer, m_readBuffer + shift, m_readIndex - shift);
+    rebaseReadPointers(m_readBuffer + shift, m_readBuffer);
+    m_readIndex -= shift;
+    m_checkedIndex -= shift;
+    m_startLine -= shift;
+    m_requestStart = 0;
+}
+
+bool HttpConn::acquireReadBuffer()
+{
+    if (!m_readBuffer)
+        m_readBuffer = BufferPool::getInstance()->acquire(READ_BUFFER_SIZE, m_readCapacity);
+    return m_readBuffer != nullptr;
+}
+
+// 保证读缓冲区还能容纳length字节（另留一个字节作为结束符的余量）
+// 空间不足时换用更大一级的缓冲区，已解析出的指针随之平移
+bool HttpConn::reserveReadSpace(int length)
+{
+    if (!acquireReadBuffer() || m_readIndex + length > m_maxRequestSize)
+        return false;
+    if (m_readIndex + length <= m_readCapacity - 1)
+        return true;
+
+    int capacity;
+    char *buffer = BufferPool::getInstance()->acquire(m_readIndex + length + 1, capacity);
+    if (!buffer)
+        return false;
+    memcpy(buffer, m_readBuffer, m_readIndex);
+    rebaseReadPointers(m_readBuffer, buffer);
+
+    BufferPool::getInstance()->release(m_readBuffer, m_readCapacity);
+    m_readBuffer = buffer;
+    m_readCapacity = capacity;
+    return true;
+}
+
+bool HttpConn::acquireWriteBuffer()
+{
+    if (!m_writeBuffer)
+        m_writeBuffer = BufferPool::getInstance()->acquire(MAX_WRITE_BUFFER_SIZE, m_writeCapacity);
+    return m_writeBuffer != nullptr;
+}
+
+// 写缓冲区不够时换用更大一级的缓冲区；iovec在响应全部入队后才生成，不会指向旧缓冲区
+bool HttpConn::growWriteBuffer()
+{
+    int capacity;
+    char *buffer = BufferPool::getInstance()->acquire(m_writeCapacity + 1, capacity);
+    if (!buffer)
+        return false;
+    memcpy(buffer, m_writeBuffer, m_writeIndex);
+    BufferPool::getInstance()->release(m_writeBuffer, m_writeCapacity);
+    m_writeBuffer = buffer;
+    m_writeCapacity = capacity;
+    return true;
+}
+
+void HttpConn::releaseBuffers()
+{
+    if (m_readBuffer)
+    {
+        BufferPool::getInstance()->release(m_readBuffer, m_readCapacity);
+        m_readBuffer = nullptr;
+    }
+    if (m_writeBuffer)
+    {
+        BufferPool::getInstance()->release(m_writeBuffer, m_writeCapacity);
+        m_writeBuffer = nullptr;
+    }
 }
 
 // 从状态机，分析一行内容
 // 返回值为行的读取状态，LINE_OK、LINE_BAD、LINE_OPEN
 HttpConn::LineStatus HttpConn::parseLine()
 {
-    char currentChar;
-    for (; m_checkedIndex < m_readIndex; ++m_checkedIndex)
+    // 一次跳过整块不含'\r'和'\n'的字节，停在行尾或已读数据的末尾
+    m_checkedIndex += findLineEnd(m_readBuffer + m_checkedIndex, m_readIndex - m_checkedIndex);
+    if (m_checkedIndex >= m_readIndex)
+        return LINE_OPEN;
+
+    char currentChar = m_readBuffer[m_checkedIndex];
+    if (currentChar == '\r')
     {
-        currentChar = m_readBuffer[m_checkedIndex];
-        if (currentChar == '\r')
+        // '\r'落在已读数据的末尾：停在它上面，等'\n'到达后再判断
+        if ((m_checkedIndex + 1) == m_readIndex)
+            return LINE_OPEN;
+        else if (m_readBuffer[m_checkedIndex + 1] == '\n')
         {
-            if ((m_checkedIndex + 1) == m_readIndex)
-                return LINE_OPEN;
-            else if (m_readBuffer[m_checkedIndex + 1] == '\n')
-            {
-                m_readBuffer[m_checkedIndex++] = '\0';
-                m_readBuffer[m_checkedIndex++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        }
-        else if (currentChar == '\n')
-        {
-            if (m_checkedIndex > 1 && m_readBuffer[m_checkedIndex - 1] == '\r')
-            {
-                m_readBuffer[m_checkedIndex - 1] = '\0';
-                m_readBuffer[++ m_checkedIndex] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
+            m_readBuffer[m_checkedIndex++] = '\0';
+            m_readBuffer[m_checkedIndex++] = '\0';
+            return LINE_OK;
         }
+        return LINE_BAD;
     }
-    return LINE_OPEN;
+    // A bare '\n'
+    return LINE_BAD;
 }
 
 
@@ -206,17 +404,31 @@ HttpConn::LineStatus HttpConn::parseLine()
 // 非阻塞ET工作模式下，需要一次性将数据读完
 bool HttpConn::readFromSocket()
 {
-    if (m_readIndex >= MAX_READ_BUFFER_SIZE)
+    // Room for at least one more byte; a full buffer is promoted to the next size class
+    if (!reserveReadSpace(1))
     {
         return false;
     }
 
     int bytesRead = 0;
 
+    // Upload content goes from the socket straight into the staged file; what splice leaves behind
+    // (delimiters and part headers) is read into the buffer as usual
+    if (m_upload && m_checkState == CHECK_STATE_CONTENT && !m_bodyDecoder.isChunked() && m_checkedIndex == m_readIndex)
+    {
+        long moved = m_upload->spliceFrom(m_socketFd, m_bodyDecoder.remaining());
+        if (moved < 0)
+            return false;
+        m_bodyDecoder.skip(moved);
+        // LT: the socket may be empty now, and recv's EAGAIN would read as an error
+        if (moved > 0 && m_triggerMode == 0)
+            return true;
+    }
+
     // LT read mode
     if (m_triggerMode == 0)
     {
-        bytesRead = recv(m_socketFd, m_readBuffer + m_readIndex, MAX_READ_BUFFER_SIZE - m_readIndex, 0);
+        bytesRead = recv(m_socketFd, m_readBuffer + m_readIndex, readSpace(), 0);
         if (bytesRead > 0)
         {
             m_readIndex += bytesRead;
@@ -229,7 +441,11 @@ bool HttpConn::readFromSocket()
     {
         while (true)
         {
-            bytesRead = recv(m_socketFd, m_readBuffer + m_readIndex, MAX_READ_BUFFER_SIZE - m_readIndex, 0);
+            // A full buffer is parsed first: an arriving body is consumed and makes room instead of
+            // growing the buffer; epoll reports the rest again once the socket is re-armed
+            if (readSpace() <= 0)
+                break;
+            bytesRead = recv(m_socketFd, m_readBuffer + m_readIndex, readSpace(), 0);
             if (bytesRead == -1)
             {
                 if (errno == EAGAIN || errno == EWOULDBLOCK)
@@ -248,10 +464,11 @@ bool HttpConn::readFromSocket()
 
 
 // 解析http请求行，获得请求方法，目标url及http版本号
-HttpConn::HttpCode HttpConn::parseRequestLine(char *text)
+HttpConn::HttpCode HttpConn::parseRequestLine(char *text, int length)
 {
-    m_url = strpbrk(text, " \t");
-    if (!m_url)
+    char *end = text + length;
+    m_url = text + findBlank(text, length);
+    if (m_url == end)
     {
         return BAD_REQUEST;
     }
@@ -269,13 +486,15 @@ HttpConn::HttpCode HttpConn::parseRequestLine(char *text)
         return BAD_REQUEST;
 
     m_url += strspn(m_url, " \t");
-    m_version = strpbrk(m_url, " \t");
-    if (!m_version)
+    m_version = m_url + findBlank(m_url, end - m_url);
+    if (m_version == end)
         return BAD_REQUEST;
     *m_version++ = '\0';
     m_version += strspn(m_version, " \t");
 
-    if (strcasecmp(m_version, "HTTP/1.1") != 0)
+    if (strcasecmp(m_version, "HTTP/1.0") == 0)
+        m_http10 = true;
+    else if (strcasecmp(m_version, "HTTP/1.1") != 0)
         return BAD_REQUEST;
 
     if (strncasecmp(m_url, "http://", 7) == 0)
@@ -302,58 +521,205 @@ HttpConn::HttpCode HttpConn::parseRequestLine(char *text)
 }
 
 // 解析http请求头部的一行
-HttpConn::HttpCode HttpConn::parseHeaders(char *text)
+HttpConn::HttpCode HttpConn::parseHeaders(char *text, int length)
 {
-    if (text[0] == '\0')
+    if (length == 0)
     {
-        if (m_contentLength != 0)
-        {
-            m_checkState = CHECK_STATE_CONTENT;
-            return NO_REQUEST;
-        }
-        return GET_REQUEST;
+        m_keepAlive = wantsKeepAlive();
+        return beginBody();
     }
-    else if (strncasecmp(text, "Connection:", 11) == 0)
+
+    // 名称在冒号之前，一次哈希得到它是哪个已知的头部；只记录位置，值留在读缓冲区中
+    char *colon = static_cast<char *>(memchr(text, ':', length));
+    // A line that is not a header is skipped, as before
+    if (!colon || colon == text)
+        return NO_REQUEST;
+    char *value = colon + 1;
+    value += strspn(value, " \t");
+    char *end = text + length;
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t'))
+        --end;
+    *end = '\0';
+
+    HeaderId id = classifyHeader(text, colon - text);
+    char *request = m_readBuffer + m_requestStart;
+    if (!m_headers.add(id, text - request, colon - text, value - request, end - value))
+        return BAD_REQUEST;
+
+    // 正文长度决定后续的解析，在这里就取出
+    if (id == HEADER_CONTENT_LENGTH)
     {
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0)
-        {
-            m_keepAlive = true;
-        }
+        char *digitsEnd;
+        m_contentLength = strtol(value, &digitsEnd, 10);
+        if (digitsEnd == value || *digitsEnd != '\0' || m_contentLength < 0)
+            return BAD_REQUEST;
     }
-    else if (strncasecmp(text, "Content-Length:", 15) == 0)
+    return NO_REQUEST;
+}
+
+// HTTP/1.1的连接默认保持，Connection: close关闭；HTTP/1.0只有Connection: keep-alive才保持
+// Connection的值是逗号分隔的选项列表，close优先
+bool HttpConn::wantsKeepAlive() const
+{
+    const char *connection = header(HEADER_CONNECTION);
+    bool keepAlive = !m_http10;
+    if (!connection)
+        return keepAlive;
+    const char *option = connection + strspn(connection, ", \t");
+    while (*option)
     {
-        text += 15;
-        text += strspn(text, " \t");
-        m_contentLength = atol(text);
+        int length = strcspn(option, ", \t");
+        if (length == 5 && strncasecmp(option, "close", 5) == 0)
+            return false;
+        if (length == 10 && strncasecmp(option, "keep-alive", 10) == 0)
+            keepAlive = true;
+        option += length;
+        option += strspn(option, ", \t");
     }
-    else if (strncasecmp(text, "Host:", 5) == 0)
+    return keepAlive;
+}
+
+// 解析http请求正文
+// 头部结束：确定正文的编码，没有正文时请求已完整
+HttpConn::HttpCode HttpConn::beginBody()
+{
+    const char *transferEncoding = header(HEADER_TRANSFER_ENCODING);
+    if (transferEncoding)
+    {
+        // Both framings at once is how requests get smuggled past proxies
+        if (strcasecmp(transferEncoding, "chunked") != 0 || m_headers.has(HEADER_CONTENT_LENGTH))
+            return BAD_REQUEST;
+        m_bodyDecoder.startChunked();
+    }
+    else if (m_contentLength > 0)
     {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
+        m_bodyDecoder.startIdentity(m_contentLength);
     }
     else
     {
-        LOG_INFO(m_logStatus, "Unknown header: %s", text);
+        return GET_REQUEST;
+    }
+
+    if (m_method == POST && strcmp(m_url, UPLOAD_PATH) == 0)
+    {
+        HttpCode result = beginUpload();
+        if (result != NO_REQUEST)
+            return result;
+    }
+
+    m_checkState = CHECK_STATE_CONTENT;
+    m_bodyStart = m_checkedIndex;
+    // 登录和注册的表单需要完整的正文，其余的正文边到达边交给处理者，不在缓冲区中累积
+    const char *p = strrchr(m_url, '/');
+    m_retainBody = m_isCgi == 1 && (p[1] == '2' || p[1] == '3');
+    // A streamed body is read through a fixed window: large enough to keep syscalls per byte low,
+    // and the memory of an upload stays at this size however long the body is
+    if (!m_retainBody)
+    {
+        int window = BODY_WINDOW_SIZE;
+        if (m_readIndex + window > m_maxRequestSize)
+            window = m_maxRequestSize - m_readIndex;
+        // Without it the current buffer still works, just with more reads
+        if (window > readSpace())
+            reserveReadSpace(window);
+    }
+
+    // The client waits for the interim response before sending the body; skip it when the body
+    // is already here or responses queued ahead of this one would be overtaken
+    const char *expect = header(HEADER_EXPECT);
+    if (expect && strcasecmp(expect, "100-continue") == 0 && !m_http10 && m_checkedIndex == m_readIndex
+        && m_responseCount == 0)
+    {
+        static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        ssize_t sent = send(m_socketFd, CONTINUE, sizeof(CONTINUE) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+        // Nothing sent (EAGAIN) is harmless, the client sends the body once its own wait runs out.
+        // Part of the status line would run into the final response, so the connection is closed instead
+        if (sent != (ssize_t)sizeof(CONTINUE) - 1 && !(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)))
+        {
+            m_keepAlive = false;
+            return CLOSED_CONNECTION;
+        }
     }
     return NO_REQUEST;
 }
 
-// 解析http请求正文
-HttpConn::HttpCode HttpConn::parseContent(char *text)
+// 上传的大小在正文到达之前检查，超出时不读正文，回复413后关闭连接
+HttpConn::HttpCode HttpConn::beginUpload()
 {
-    if (m_readIndex >= (m_contentLength + m_checkedIndex))
+    if (m_maxUploadSize == 0 || m_contentLength > m_maxUploadSize)
     {
-        text[m_contentLength] = '\0';
-        // In POST requests, the last part contains the input username and password
-        m_requestData = text;
-        return GET_REQUEST;
+        m_keepAlive = false;
+        Metrics::getInstance()->add(METRIC_UPLOADS_REJECTED);
+        return PAYLOAD_TOO_LARGE;
+    }
+    const char *contentType = header(HEADER_CONTENT_TYPE);
+    m_upload = new Upload(m_uploadDirectory, m_logStatus);
+    if (!contentType || !m_upload->begin(contentType))
+    {
+        m_keepAlive = false;
+        return BAD_REQUEST;
     }
     return NO_REQUEST;
 }
 
+// 未完成的上传在这里中止，已写入的暂存文件随之删除
+void HttpConn::releaseUpload()
+{
+    delete m_upload;
+    m_upload = nullptr;
+}
+
+// 解码已到达的正文：保留的正文在缓冲区中连续存放，其余的交给consumeBody后丢弃
+// 被去掉的分块格式和已消费的正文所占的空间立即让给后续的数据，缓冲区不随正文增长
+HttpConn::HttpCode HttpConn::parseContent()
+{
+    char *data = m_readBuffer + m_checkedIndex;
+    int available = m_readIndex - m_checkedIndex;
+    int consumed, produced;
+    BodyDecoder::Status status = m_bodyDecoder.decode(data, available, consumed, produced);
+    if (status == BodyDecoder::BODY_ERROR)
+        return BAD_REQUEST;
+
+    int kept = produced;
+    if (!m_retainBody)
+    {
+        if (!consumeBody(data, produced))
+        {
+            m_keepAlive = false;
+            return m_upload->ioFailed() ? INTERNAL_ERROR : BAD_REQUEST;
+        }
+        kept = 0;
+    }
+    if (kept != consumed)
+        memmove(data + kept, data + consumed, available - consumed);
+    m_checkedIndex += kept;
+    m_readIndex -= consumed - kept;
+
+    // A chunked upload only shows its size as it arrives
+    if (m_upload && m_bodyDecoder.received() > m_maxUploadSize)
+    {
+        m_keepAlive = false;
+        Metrics::getInstance()->add(METRIC_UPLOADS_REJECTED);
+        return PAYLOAD_TOO_LARGE;
+    }
+    if (status == BodyDecoder::BODY_MORE)
+        return NO_REQUEST;
+    if (m_upload && !m_upload->isDone())
+        return BAD_REQUEST;
+    // 正文不以'\0'结尾，其后可能紧跟管线化的下一个请求
+    m_requestData = m_readBuffer + m_bodyStart;
+    m_contentLength = m_bodyDecoder.received();
+    return GET_REQUEST;
+}
+
+// 不需要保留的正文片段，到达一段处理一段：上传的交给multipart解析，其余的丢弃
+bool HttpConn::consumeBody(const char *data, int length)
+{
+    if (!m_upload)
+        return true;
+    return m_upload->feed(data, length);
+}
+
 HttpConn::HttpCode HttpConn::processRead(ConnectionPool* connPool)
 {
     LineStatus lineStatus = LINE_OK;
@@ -363,6 +729,8 @@ HttpConn::HttpCode HttpConn::processRead(ConnectionPool* connPool)
     while ((m_checkState == CHECK_STATE_CONTENT && lineStatus == LINE_OK) || ((lineStatus = parseLine()) == LINE_OK))
     {
         line = currentLine();
+        // parseLine replaced the CRLF with two '\0'
+        int lineLength = m_checkedIndex - m_startLine - 2;
         m_startLine = m_checkedIndex;
         LOG_INFO("%s", line);
 
@@ -370,29 +738,28 @@ HttpConn::HttpCode HttpConn::processRead(ConnectionPool* connPool)
         {
         case CHECK_STATE_REQUEST_LINE:
         {
-            result = parseRequestLine(line);
+            result = parseRequestLine(line, lineLength);
             if (result == BAD_REQUEST)
                 return BAD_REQUEST;
             break;
         }
         case CHECK_STATE_HEADER:
         {
-            result = parseHeaders(line);
-            if (result == BAD_REQUEST)
-                return BAD_REQUEST;
-            else if (result == GET_REQUEST)
-            {
+            result = parseHeaders(line, lineLength);
+            if (result == GET_REQUEST)
                 return generateRequest(connPool);
-            }
+            // An error, or an upload refused before its body
+            if (result != NO_REQUEST)
+                return result;
             break;
         }
         case CHECK_STATE_CONTENT:
         {
-            result = parseContent(line);
+            result = parseContent();
             if (result == GET_REQUEST)
                 return generateRequest(connPool);
-            lineStatus = LINE_OPEN;
-            break;
+            // Body incomplete: wait for more data, parseLine must not scan into the body
+            return result;
         }
         default:
             return INTERNAL_ERROR;
@@ -403,14 +770,20 @@ HttpConn::HttpCode HttpConn::processRead(ConnectionPool* connPool)
 
 void HttpConn::concatUrl(int length, const char* url)
 {
-    char* tempUrl = (char*)malloc(sizeof(char) * 200);
-    strcpy(tempUrl, url);
-    strncpy(m_realFile + length, tempUrl, strlen(tempUrl));
-    free(tempUrl);
+    // 长连接复用m_realFile，必须以'\0'结尾，不能残留上一个请求的路径
+    snprintf(m_realFile + length, MAX_FILENAME_LENGTH - length, "%s", url);
 }
 
 HttpConn::HttpCode HttpConn::generateRequest(ConnectionPool* connPool)
 {
+    if (m_upload)
+        return UPLOAD_REQUEST;
+    // POST /upload without a body
+    if (m_method == POST && strcmp(m_url, UPLOAD_PATH) == 0)
+        return BAD_REQUEST;
+    if (m_method == GET && strcmp(m_url, METRICS_PATH) == 0)
+        return METRICS_REQUEST;
+
     strcpy(m_realFile, m_docRoot);
     int length = strlen(m_docRoot);
     const char *p = strrchr(m_url, '/');
@@ -425,16 +798,18 @@ HttpConn::HttpCode HttpConn::generateRequest(ConnectionPool* connPool)
         strncpy(m_realFile + length, tempUrl, MAX_FILENAME_LENGTH - length - 1);
         free(tempUrl);
 
-        // Extract username and password
+        // Extract username and password: user=...&password=...
         char username[100], password[100];
-        int i;
-        for (i = 5; m_requestData[i] != '&'; ++i)
-            username[i - 5] = m_requestData[i];
-        username[i - 5] = '\0';
-
-        int j = 0;
-        for (i = i + 10; m_requestData[i] != '\0'; ++i, ++j)
-            password[j] = m_requestData[i];
+        int i, j = 0;
+        for (i = 5; i < m_contentLength && m_requestData[i] != '&'; ++i)
+            if (j < (int)sizeof(username) - 1)
+                username[j++] = m_requestData[i];
+        username[j] = '\0';
+
+        j = 0;
+        for (i = i + 10; i < m_contentLength; ++i)
+            if (j < (int)sizeof(password) - 1)
+                password[j++] = m_requestData[i];
         password[j] = '\0';
 
         if (*(p + 1) == '3')
@@ -447,16 +822,26 @@ HttpConn::HttpCode HttpConn::generateRequest(ConnectionPool* connPool)
             strcat(sqlInsert, password);
             strcat(sqlInsert, "')");
 
-            if (m_users.find(username) == m_users.end())
+            // The name is reserved in the table first, so m_lock is not held across the database call
+            m_lock.lock();
+            bool reserved = m_users.insert(std::pair<std::string, std::string>(username, password)).second;
+            m_lock.unlock();
+            if (reserved)
             {
-                m_lock.lock();
-                MYSQL *mysql = nullptr;
-                ConnectionRAII mysqlConn(&mysql, connPool);
-
-                if (!mysql) std::cout << "None\n";
-                int result = mysql_query(mysql, sqlInsert);
-                m_users.insert(std::pair<std::string, std::string>(username, password));
-                m_lock.unlock();
+                // 只在写数据库时占用连接，语句执行完立即归还
+                int result = 1;
+                {
+                    MYSQL *mysql = nullptr;
+                    ConnectionRAII mysqlConn(&mysql, connPool);
+                    if (mysql)
+                        result = mysql_query(mysql, sqlInsert);
+                }
+                if (result)
+                {
+                    m_lock.lock();
+                    m_users.erase(username);
+                    m_lock.unlock();
+                }
 
                 if (!result)
                     strcpy(m_url, "/log.html");
@@ -470,8 +855,12 @@ HttpConn::HttpCode HttpConn::generateRequest(ConnectionPool* connPool)
         }
         else if (*(p + 1) == '2')
         {
-            // Login
-            if (m_users.find(username) != m_users.end() && m_users[username] == password)
+            // Login: answered from the table loaded at startup, no database connection
+            m_lock.lock();
+            std::map<std::string, std::string>::const_iterator user = m_users.find(username);
+            bool valid = user != m_users.end() && user->second == password;
+            m_lock.unlock();
+            if (valid)
                 strcpy(m_url, "/menu.html");
             else
                 strcpy(m_url, "/logError.html");
@@ -504,6 +893,28 @@ HttpConn::HttpCode HttpConn::generateRequest(ConnectionPool* connPool)
             break;
     }
 
+    // 命中缓存时直接使用缓存的stat、映射和fd，不再访问文件系统
+    m_cachedFile = FileCache::getInstance()->acquire(m_realFile);
+    if (m_cachedFile)
+    {
+        // 内容协商：客户端接受时改用压缩变体，之后的条件请求和Range都针对变体
+        const char *acceptEncoding = header(HEADER_ACCEPT_ENCODING);
+        int encodings = acceptEncoding ? parseAcceptEncoding(acceptEncoding) : 0;
+        if (m_method == GET && m_cachedFile->compressible && encodings)
+        {
+            CachedFile *variant = FileCache::getInstance()->acquireEncoded(m_realFile, encodings);
+            if (variant)
+            {
+                FileCache::getInstance()->release(m_cachedFile);
+                m_cachedFile = variant;
+            }
+        }
+        m_fileStat = m_cachedFile->fileStat;
+        if (isNotModified(m_cachedFile->etag.c_str()))
+            return NOT_MODIFIED;
+        return checkRange(m_cachedFile->etag.c_str());
+    }
+
     if (stat(m_realFile, &m_fileStat) < 0)
         return NO_RESOURCE;
 
@@ -513,102 +924,482 @@ HttpConn::HttpCode HttpConn::generateRequest(ConnectionPool* connPool)
     if (S_ISDIR(m_fileStat.st_mode))
         return BAD_REQUEST;
 
-    int fd = open(m_realFile, O_RDONLY);
-    m_fileAddress = (char *)mmap(0, m_fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-    return FILE_REQUEST;
+    // The client's copy is current, or the range cannot be served: answer before opening the file
+    HttpCode fileResult = FILE_REQUEST;
+    if (m_fileStat.st_size > 0)
+    {
+        char etag[48];
+        formatEntityTag(m_fileStat, etag, sizeof(etag));
+        if (isNotModified(etag))
+            return NOT_MODIFIED;
+        fileResult = checkRange(etag);
+        if (fileResult == RANGE_NOT_SATISFIABLE)
+            return fileResult;
+    }
+
+    // Empty files get a placeholder page, mmap of length 0 would fail
+    if (m_fileStat.st_size > 0)
+    {
+        int fd = open(m_realFile, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return INTERNAL_ERROR;
+        // sendfile模式：持有fd直到正文发完，不建立映射
+        if (m_sendFile)
+        {
+            m_fileFd = fd;
+            return fileResult;
+        }
+        m_fileAddress = (char *)mmap(0, m_fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (m_fileAddress == MAP_FAILED)
+        {
+            m_fileAddress = nullptr;
+            return INTERNAL_ERROR;
+        }
+    }
+    return fileResult;
 }
 
-void HttpConn::releaseMemory()
+// 条件GET：If-None-Match优先，没有时才比较If-Modified-Since
+bool HttpConn::isNotModified(const char *etag)
+{
+    if (m_method != GET)
+        return false;
+    const char *ifNoneMatch = header(HEADER_IF_NONE_MATCH);
+    if (ifNoneMatch)
+        return entityTagMatches(ifNoneMatch, etag);
+    const char *ifModifiedSince = header(HEADER_IF_MODIFIED_SINCE);
+    time_t since;
+    if (ifModifiedSince && parseHttpDate(ifModifiedSince, since))
+        return m_fileStat.st_mtime <= since;
+    return false;
+}
+
+// Range请求：If-Range不匹配或Range无法解析时忽略，发送整个文件
+HttpConn::HttpCode HttpConn::checkRange(const char *etag)
+{
+    const char *range = header(HEADER_RANGE);
+    if (m_method != GET || !range || m_fileStat.st_size == 0)
+        return FILE_REQUEST;
+    const char *ifRange = header(HEADER_IF_RANGE);
+    if (ifRange && !ifRangeMatches(ifRange, etag, m_fileStat.st_mtime))
+        return FILE_REQUEST;
+
+    int count = parseByteRanges(range, m_fileStat.st_size, m_ranges, MAX_RANGES);
+    if (count < 0)
+        return FILE_REQUEST;
+    if (count == 0)
+        return RANGE_NOT_SATISFIABLE;
+    m_rangeCount = count;
+    return PARTIAL_CONTENT;
+}
+
+// 释放当前请求的文件（尚未交给发送队列的映射、fd或缓存引用）
+void HttpConn::releaseFile()
 {
     if (m_fileAddress)
     {
         munmap(m_fileAddress, m_fileStat.st_size);
         m_fileAddress = nullptr;
     }
+    if (m_fileFd != -1)
+    {
+        close(m_fileFd);
+        m_fileFd = -1;
+    }
+    if (m_cachedFile)
+    {
+        FileCache::getInstance()->release(m_cachedFile);
+        m_cachedFile = nullptr;
+    }
 }
 
-bool HttpConn::writeToSocket()
+void HttpConn::releaseMemory()
 {
-    int bytes_written = 0;
+    releaseFile();
+    for (int i = 0; i < m_responseCount; ++i)
+    {
+        if (!m_responses[i].ownsFile)
+            continue;
+        if (m_responses[i].cachedFile)
+        {
+            FileCache::getInstance()->release(m_responses[i].cachedFile);
+            continue;
+        }
+        if (m_responses[i].fileAddress)
+            munmap(m_responses[i].fileAddress, m_responses[i].mappedSize);
+        if (m_responses[i].fileFd != -1)
+            close(m_responses[i].fileFd);
+    }
+    m_responseCount = 0;
+    m_sendFd = -1;
+}
+
+bool HttpConn::writeToSocket(bool &requestBuffered, bool &idle)
+{
+    ssize_t bytes_written = 0;
+    requestBuffered = false;
+    idle = false;
 
     if (m_bytesToSend == 0)
     {
-        modFd(g_epollFd, m_socketFd, EPOLLIN, m_triggerMode);
+        idle = true;
+        modFd(m_epollFd, m_socketFd, EPOLLIN, m_triggerMode);
         reset();
         return true;
     }
 
     while (true)
     {
-        bytes_written = writev(m_socketFd, m_iov, m_iovCount);
+        bytes_written = sendPending();
 
         if (bytes_written < 0)
         {
             if (errno == EAGAIN)
             {
-                modFd(g_epollFd, m_socketFd, EPOLLOUT, m_triggerMode);
+                modFd(m_epollFd, m_socketFd, EPOLLOUT, m_triggerMode);
                 return true;
             }
             releaseMemory();
             return false;
         }
 
-        m_bytesHaveSent += bytes_written;
-        m_bytesToSend -= bytes_written;
-        if (m_bytesHaveSent >= m_iov[0].iov_len)
+        if (advanceWrite(bytes_written))
         {
-            m_iov[0].iov_len = 0;
-            m_iov[1].iov_base = m_fileAddress + (m_bytesHaveSent - m_writeIndex);
-            m_iov[1].iov_len = m_bytesToSend;
+            // Reset before re-arming so the next request never sees the old state
+            // A buffered pipelined request is handed back to the caller instead, which processes it right away
+            bool keepAlive = finishResponse();
+            requestBuffered = keepAlive && hasBufferedRequest();
+            // Decided before re-arming: afterwards another thread may already be reading
+            idle = keepAlive && isIdle();
+            if (keepAlive && !requestBuffered)
+                modFd(m_epollFd, m_socketFd, EPOLLIN, m_triggerMode);
+            return keepAlive;
         }
-        else
+    }
+}
+
+// 发送下一段：iovec中的头部（及mmap的正文），或sendfile模式下当前的文件正文
+// sendfile从持有的fd按偏移续传，EAGAIN后由m_bytesHaveSent重新定位
+ssize_t HttpConn::sendPending()
+{
+    if (m_iovCount == 0 && m_sendFd != -1)
+    {
+        off_t offset = m_sendOffset;
+        ssize_t sent = sendfile(m_socketFd, m_sendFd, &offset, m_sendLength);
+        // The file shrank under us: the promised Content-Length can no longer be met
+        if (sent == 0)
         {
-            m_iov[0].iov_base = m_writeBuffer + m_bytesHaveSent;
-            m_iov[0].iov_len -= m_bytesHaveSent;
+            errno = EIO;
+            return -1;
         }
+        return sent;
+    }
+    if (!m_bodyFollows)
+        return writev(m_socketFd, m_iov, m_iovCount);
+
+    // Headers go out with MSG_MORE so they share a segment with the start of the body
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = m_iov;
+    message.msg_iovlen = m_iovCount;
+    return sendmsg(m_socketFd, &message, MSG_MORE);
+}
 
-        if (m_bytesToSend <= 0)
-        {
-            releaseMemory();
-            modFd(g_epollFd, m_socketFd, EPOLLIN, m_triggerMode);
+// 记录已发送的字节数并调整iovec，返回响应是否已全部发出
+bool HttpConn::advanceWrite(long bytesWritten)
+{
+    m_bytesHaveSent += bytesWritten;
+    m_bytesToSend -= bytesWritten;
+    buildIov();
+    return m_bytesToSend <= 0;
+}
 
-            if (m_keepAlive)
-            {
-                reset();
-                return true;
-            }
-            else
-            {
-                return false;
-            }
+// 把入队的响应依次排成iovec：每个响应是写缓冲区中的一段，加上可选的文件映射
+// 已发送的字节从前面跳过；遇到sendfile的文件正文时停下，由sendPending单独发送
+void HttpConn::buildIov()
+{
+    long skip = m_bytesHaveSent;
+    int start = 0;
+    m_iovCount = 0;
+    m_sendFd = -1;
+    m_bodyFollows = false;
+    for (int i = 0; i < m_responseCount; ++i)
+    {
+        appendIov(m_writeBuffer + start, m_responses[i].end - start, skip);
+        start = m_responses[i].end;
+        if (m_responses[i].fileFd == -1)
+        {
+            if (m_responses[i].fileAddress)
+                appendIov(m_responses[i].fileAddress + m_responses[i].fileOffset, m_responses[i].fileSize, skip);
+            continue;
+        }
+        if (skip >= m_responses[i].fileSize)
+        {
+            skip -= m_responses[i].fileSize;
+            continue;
         }
+        if (m_iovCount > 0)
+        {
+            m_bodyFollows = true;
+        }
+        else
+        {
+            m_sendFd = m_responses[i].fileFd;
+            m_sendOffset = m_responses[i].fileOffset + skip;
+            m_sendLength = m_responses[i].fileSize - skip;
+        }
+        break;
+    }
+}
+
+void HttpConn::appendIov(char *base, long length, long &skip)
+{
+    if (skip >= length)
+    {
+        skip -= length;
+        return;
     }
+    m_iov[m_iovCount].iov_base = base + skip;
+    m_iov[m_iovCount].iov_len = length - skip;
+    ++m_iovCount;
+    skip = 0;
+}
+
+// 写缓冲区中到目前为止的头部，加上文件的[offset, offset + length)，作为一项入队
+void HttpConn::queuePart(long offset, long length, bool ownsFile)
+{
+    QueuedResponse &response = m_responses[m_responseCount++];
+    int start = m_responseCount > 1 ? m_responses[m_responseCount - 2].end : 0;
+    response.end = m_writeIndex;
+    response.fileAddress = m_fileAddress;
+    response.fileFd = m_fileFd;
+    response.mappedSize = m_fileAddress ? m_fileStat.st_size : 0;
+    response.cachedFile = m_cachedFile;
+    if (m_cachedFile)
+    {
+        // Bytes compressed in memory have no fd and always go through writev
+        if (m_sendFile && m_cachedFile->fd != -1)
+            response.fileFd = m_cachedFile->fd;
+        else
+            response.fileAddress = m_cachedFile->address;
+    }
+    response.fileOffset = offset;
+    response.fileSize = length;
+    response.ownsFile = ownsFile;
+    response.keepAlive = m_keepAlive;
+    m_bytesToSend += (response.end - start) + response.fileSize;
+}
+
+// 当前请求的响应已生成：记录其在写缓冲区中的结束位置，接管文件，并开始解析下一个请求
+void HttpConn::queueResponse()
+{
+    queuePart(m_bodyOffset, m_bodyLength, true);
+    m_fileAddress = nullptr;
+    m_fileFd = -1;
+    m_cachedFile = nullptr;
+
+    beginRequest();
 }
 
+// 入队的响应全部发送完毕：释放文件映射和写缓冲区，长连接则保留后续请求的数据
+bool HttpConn::finishResponse()
+{
+    bool keepAlive = isKeepAlive();
+    releaseMemory();
+    m_writeIndex = 0;
+    m_bytesToSend = 0;
+    m_bytesHaveSent = 0;
+    m_iovCount = 0;
+    m_bodyFollows = false;
+    if (m_writeBuffer)
+    {
+        BufferPool::getInstance()->release(m_writeBuffer, m_writeCapacity);
+        m_writeBuffer = nullptr;
+    }
+
+    if (!keepAlive)
+        return false;
+    compactReadBuffer();
+    return true;
+}
 
-bool HttpConn::appendResponse(const char *format, ...)
+// Copy bytes received by a completion-based backend into the read buffer
+bool HttpConn::appendReadData(const char *data, int length)
+{
+    if (!reserveReadSpace(length))
+        return false;
+    memcpy(m_readBuffer + m_readIndex, data, length);
+    m_readIndex += length;
+    return true;
+}
+
+
+// 写缓冲区中留出length字节，必要时换用更大的缓冲区；超出缓冲池的最大级别时记录错误并返回nullptr
+char *HttpConn::reserveWrite(int length)
+{
+    if (!acquireWriteBuffer())
+        return nullptr;
+    // Several pipelined responses share the buffer
+    while (m_writeIndex + length > m_writeCapacity)
+    {
+        if (!growWriteBuffer())
+        {
+            LOG_ERROR(m_logStatus, "response does not fit the write buffer: %d bytes queued, %d more",
+                      m_writeIndex, length);
+            return nullptr;
+        }
+    }
+    return m_writeBuffer + m_writeIndex;
+}
+bool HttpConn::appendRaw(const char *data, int length)
+{
+    char *out = reserveWrite(length);
+    if (!out)
+        return false;
+    memcpy(out, data, length);
+    m_writeIndex += length;
+    return true;
+}
+bool HttpConn::appendNumber(long value)
+{
+    char *out = reserveWrite(21);
+    if (!out)
+        return false;
+    if (value < 0)
+    {
+        *out++ = '-';
+        ++m_writeIndex;
+        value = -value;
+    }
+    m_writeIndex += formatDecimal(value, out);
+    return true;
+}
+// 预先生成的错误响应，只有Connection头部现场生成
+bool HttpConn::appendError(HttpCode code)
+{
+    for (size_t i = 0; i < sizeof(ERROR_RESPONSES) / sizeof(ERROR_RESPONSES[0]); ++i)
+    {
+        const ErrorResponse &response = ERROR_RESPONSES[i];
+        if (response.code == code)
+            return appendRaw(response.head.data(), response.head.size())
+                && appendKeepAlive()
+                && appendRaw(response.tail.data(), response.tail.size());
+    }
+    return false;
+}
+// 文件响应头：缓存命中时直接使用预先生成的头部，否则现场生成到buffer中
+const char *HttpConn::fileHeaders(char *buffer, int size, int &length, int &typeOffset, int &validatorOffset)
 {
-    if (m_writeIndex >= MAX_WRITE_BUFFER_SIZE)
+    if (m_cachedFile)
+    {
+        length = m_cachedFile->headers.size();
+        typeOffset = m_cachedFile->typeOffset;
+        validatorOffset = m_cachedFile->validatorOffset;
+        return m_cachedFile->headers.data();
+    }
+    length = formatFileHeaders(m_realFile, m_fileStat, ENCODING_IDENTITY, m_cacheMaxAge, buffer, size, typeOffset, validatorOffset);
+    return length < 0 ? nullptr : buffer;
+}
+// validatorsOnly用于304，只发送ETag、Last-Modified和Cache-Control
+bool HttpConn::appendFileHeaders(bool validatorsOnly)
+{
+    char buffer[512];
+    int length, typeOffset, validatorOffset;
+    const char *headers = fileHeaders(buffer, sizeof(buffer), length, typeOffset, validatorOffset);
+    if (!headers)
         return false;
-    va_list args;
-    va_start(args, format);
-    int len = vsnprintf(m_writeBuffer + m_writeIndex, MAX_WRITE_BUFFER_SIZE - 1 - m_writeIndex, format, args);
-    if (len >= (MAX_WRITE_BUFFER_SIZE - 1 - m_writeIndex))
+    if (validatorsOnly)
     {
-        va_end(args);
+        headers += validatorOffset;
+        length -= validatorOffset;
+    }
+    return appendRaw(headers, length) && appendKeepAlive() && appendBlankLine();
+}
+// multipart/byteranges中一个分段之前的分隔符和头部，写入out（至少256字节），返回长度
+static int formatRangePart(const char *type, int typeLength, const ByteRange &range, long fileSize, char *out)
+{
+    static const char DELIMITER[] = "\r\n--";
+    static const char TYPE[] = "\r\nContent-Type:";
+    static const char RANGE[] = "\r\nContent-Range:bytes ";
+    char *p = out;
+    memcpy(p, DELIMITER, sizeof(DELIMITER) - 1);
+    p += sizeof(DELIMITER) - 1;
+    memcpy(p, MULTIPART_BOUNDARY, sizeof(MULTIPART_BOUNDARY) - 1);
+    p += sizeof(MULTIPART_BOUNDARY) - 1;
+    memcpy(p, TYPE, sizeof(TYPE) - 1);
+    p += sizeof(TYPE) - 1;
+    memcpy(p, type, typeLength);
+    p += typeLength;
+    memcpy(p, RANGE, sizeof(RANGE) - 1);
+    p += sizeof(RANGE) - 1;
+    p += formatDecimal(range.first, p);
+    *p++ = '-';
+    p += formatDecimal(range.last, p);
+    *p++ = '/';
+    p += formatDecimal(fileSize, p);
+    memcpy(p, "\r\n\r\n", 4);
+    return p + 4 - out;
+}
+
+// 206的头部；多个范围时按multipart/byteranges排列，每个分段的头部之后接一段文件
+// 除最后一段外的分段在这里直接入队，最后的结束分隔符由queueResponse入队
+bool HttpConn::appendRangeHeaders()
+{
+    char buffer[512];
+    int length, typeOffset, validatorOffset;
+    const char *headers = fileHeaders(buffer, sizeof(buffer), length, typeOffset, validatorOffset);
+    if (!headers)
         return false;
+    long fileSize = m_fileStat.st_size;
+
+    if (m_rangeCount == 1)
+    {
+        m_bodyOffset = m_ranges[0].first;
+        m_bodyLength = m_ranges[0].last - m_ranges[0].first + 1;
+        return appendLiteral("Content-Length:") && appendNumber(m_bodyLength)
+            && appendLiteral("\r\nContent-Range:bytes ") && appendNumber(m_ranges[0].first)
+            && appendLiteral("-") && appendNumber(m_ranges[0].last)
+            && appendLiteral("/") && appendNumber(fileSize) && appendLiteral("\r\n")
+            && appendRaw(headers + typeOffset, length - typeOffset)
+            && appendKeepAlive()
+            && appendBlankLine();
     }
-    m_writeIndex += len;
-    va_end(args);
 
-    LOG_INFO("request:%s", m_writeBuffer);
+    // 分段头部生成两次：先计算总长度，写入时再生成一次
+    const char *type = mimeType(m_realFile);
+    int typeLength = strlen(type);
+    char part[256];
+    long contentLength = sizeof("\r\n----\r\n") - 1 + sizeof(MULTIPART_BOUNDARY) - 1;
+    for (int i = 0; i < m_rangeCount; ++i)
+    {
+        contentLength += formatRangePart(type, typeLength, m_ranges[i], fileSize, part);
+        contentLength += m_ranges[i].last - m_ranges[i].first + 1;
+    }
 
-    return true;
+    if (!appendLiteral("Content-Length:") || !appendNumber(contentLength)
+        || !appendLiteral("\r\nContent-Type:multipart/byteranges; boundary=") || !appendLiteral(MULTIPART_BOUNDARY)
+        || !appendLiteral("\r\n")
+        || !appendRaw(headers + validatorOffset, length - validatorOffset)
+        || !appendKeepAlive()
+        || !appendBlankLine())
+        return false;
+    for (int i = 0; i < m_rangeCount; ++i)
+    {
+        if (!appendRaw(part, formatRangePart(type, typeLength, m_ranges[i], fileSize, part)))
+            return false;
+        queuePart(m_ranges[i].first, m_ranges[i].last - m_ranges[i].first + 1, false);
+    }
+    return appendLiteral("\r\n--") && appendLiteral(MULTIPART_BOUNDARY) && appendLiteral("--\r\n");
 }
-bool HttpConn::appendStatusLine(int status, const char *title)
+bool HttpConn::appendStatusLine(int status)
 {
-    return appendResponse("%s %d %s\r\n", "HTTP/1.1", status, title);
+    for (size_t i = 0; i < sizeof(STATUS_LINES) / sizeof(STATUS_LINES[0]); ++i)
+    {
+        if (STATUS_LINES[i].status == status)
+            return appendRaw(STATUS_LINES[i].text, STATUS_LINES[i].length);
+    }
+    return false;
 }
 bool HttpConn::appendHeaders(int contentLength)
 {
@@ -619,100 +1410,202 @@ bool HttpConn::appendHeaders(int contentLength)
 }
 bool HttpConn::appendContentLength(int contentLength)
 {
-    return appendResponse("Content-Length:%d\r\n", contentLength);
+    return appendLiteral("Content-Length:") && appendNumber(contentLength) && appendLiteral("\r\n");
 }
 bool HttpConn::appendContentType()
 {
-    return appendResponse("Content-Type:%s\r\n", "text/html");
+    return appendLiteral("Content-Type:text/html\r\n");
 }
 bool HttpConn::appendKeepAlive()
 {
-    return appendResponse("Connection:%s\r\n", (m_keepAlive ? "keep-alive" : "close"));
+    if (!m_keepAlive)
+        return appendLiteral("Connection:close\r\n");
+    if (!appendLiteral("Connection:keep-alive\r\nKeep-Alive:timeout=") || !appendNumber(m_keepAliveTimeout))
+        return false;
+    if (m_maxKeepAliveRequests > 0 && !(appendLiteral(", max=") && appendNumber(m_maxKeepAliveRequests - m_requestCount)))
+        return false;
+    return appendLiteral("\r\n");
 }
 bool HttpConn::appendBlankLine()
 {
-    return appendResponse("%s", "\r\n");
+    return appendLiteral("\r\n");
 }
 bool HttpConn::appendContent(const char *content)
 {
-    return appendResponse("%s", content);
+    return appendRaw(content, strlen(content));
+}
+bool HttpConn::appendPlainText(int status, const char *text, int length)
+{
+    return appendStatusLine(status)
+        && appendContentLength(length)
+        && appendLiteral("Content-Type:text/plain; charset=utf-8\r\n")
+        && appendKeepAlive()
+        && appendBlankLine()
+        && appendRaw(text, length);
 }
 
 
 bool HttpConn::processWrite(HttpCode result)
 {
+    // 每个连接最多回复m_maxKeepAliveRequests个请求，最后一个响应告知客户端关闭
+    ++m_requestCount;
+    if (m_maxKeepAliveRequests > 0 && m_requestCount >= m_maxKeepAliveRequests)
+        m_keepAlive = false;
+
     switch (result)
     {
+    case BAD_REQUEST:
+    case FORBIDDEN_REQUEST:
+    case NO_RESOURCE:
+    case PAYLOAD_TOO_LARGE:
     case INTERNAL_ERROR:
+    case SERVICE_UNAVAILABLE:
+        return appendError(result);
+    case FILE_REQUEST:
     {
-        appendStatusLine(500, HTTP_STATUS_INTERNAL_ERROR_TITLE);
-        appendHeaders(strlen(HTTP_STATUS_INTERNAL_ERROR_MESSAGE));
-        if (!appendContent(HTTP_STATUS_INTERNAL_ERROR_MESSAGE))
+        if (!appendStatusLine(200))
             return false;
+        if (m_fileStat.st_size != 0)
+        {
+            // The body is sent straight from the file mapping or the held fd, see queueResponse
+            m_bodyLength = m_fileStat.st_size;
+            return appendFileHeaders(false);
+        }
+        else
+        {
+            static const char EMPTY_PAGE[] = "<html><body></body></html>";
+            if (!appendHeaders(sizeof(EMPTY_PAGE) - 1) || !appendLiteral(EMPTY_PAGE))
+                return false;
+        }
         break;
     }
-    case BAD_REQUEST:
+    case PARTIAL_CONTENT:
+    {
+        return appendStatusLine(206) && appendRangeHeaders();
+    }
+    case RANGE_NOT_SATISFIABLE:
+    {
+        bool appended = appendStatusLine(416)
+            && appendLiteral("Content-Range:bytes */") && appendNumber(m_fileStat.st_size) && appendLiteral("\r\n")
+            && appendHeaders(0);
+        releaseFile();
+        return appended;
+    }
+    case UPLOAD_REQUEST:
     {
-        appendStatusLine(404, HTTP_STATUS_BAD_REQUEST_TITLE);
-        appendHeaders(strlen(HTTP_STATUS_BAD_REQUEST_MESSAGE));
-        if (!appendContent(HTTP_STATUS_BAD_REQUEST_MESSAGE))
+        char summary[Upload::MAX_FILES * (2 * MultipartParser::MAX_NAME_LENGTH + 96) + 32];
+        int length = m_upload->formatSummary(summary, sizeof(summary));
+        if (length < 0 || !appendPlainText(200, summary, length))
             return false;
+        // 回复已生成，暂存的文件保留下来
+        m_upload->commit();
+        releaseUpload();
         break;
     }
-    case FORBIDDEN_REQUEST:
+    case METRICS_REQUEST:
     {
-        appendStatusLine(403, HTTP_STATUS_FORBIDDEN_TITLE);
-        appendHeaders(strlen(HTTP_STATUS_FORBIDDEN_MESSAGE));
-        if (!appendContent(HTTP_STATUS_FORBIDDEN_MESSAGE))
+        char text[1024];
+        int length = Metrics::getInstance()->format(text, sizeof(text));
+        if (length < 0)
             return false;
-        break;
+        return appendPlainText(200, text, length);
     }
-    case FILE_REQUEST:
+    case NOT_MODIFIED:
     {
-        appendStatusLine(200, HTTP_STATUS_OK_TITLE);
-        if (m_fileStat.st_size != 0)
-        {
-            appendHeaders(m_fileStat.st_size);
-            m_iov[0].iov_base = m_writeBuffer;
-            m_iov[0].iov_len = m_writeIndex;
-            m_iov[1].iov_base = m_fileAddress;
-            m_iov[1].iov_len = m_fileStat.st_size;
-            m_iovCount = 2;
-            m_bytesToSend = m_writeIndex + m_fileStat.st_size;
-            return true;
-        }
-        else
-        {
-            const char *emptyPage = "<html><body></body></html>";
-            appendHeaders(strlen(emptyPage));
-            if (!appendContent(emptyPage))
-                return false;
-        }
-        break;
+        // 304 carries the validators but no body
+        bool appended = appendStatusLine(304) && appendFileHeaders(true);
+        releaseFile();
+        return appended;
     }
     default:
         return false;
     }
-    m_iov[0].iov_base = m_writeBuffer;
-    m_iov[0].iov_len = m_writeIndex;
-    m_iovCount = 1;
-    m_bytesToSend = m_writeIndex;
     return true;
 }
     
-void HttpConn::handleRequest(ConnectionPool* connPool)
+// 解析已读入的数据并生成响应
+// 返回NO_REQUEST表示请求不完整，CLOSED_CONNECTION表示响应无法生成，其余表示响应已就绪
+HttpConn::HttpCode HttpConn::prepareResponse(ConnectionPool* connPool)
 {
     HttpCode readResult = processRead(connPool);
-    if (readResult == NO_REQUEST)
+    if (readResult == NO_REQUEST || readResult == CLOSED_CONNECTION)
+        return readResult;
+    if (!processWrite(readResult))
+        return CLOSED_CONNECTION;
+    queueResponse();
+
+    // 管线化：缓冲区中已有的后续完整请求立即处理，响应合并到同一次writev
+    // A register stays buffered: once the responses are sent it comes back as requestBuffered and goes through
+    // the lane check instead of holding a database connection on this thread
+    while (isKeepAlive() && m_responseCount < MAX_PIPELINED_RESPONSES && m_checkedIndex < m_readIndex
+           && !needsBlockingLane())
     {
-        modFd(g_epollFd, m_socketFd, EPOLLIN, m_triggerMode);
-        return;
+        int committed = m_writeIndex;
+        int committedCount = m_responseCount;
+        long committedBytes = m_bytesToSend;
+        HttpCode result = processRead(connPool);
+        if (result == NO_REQUEST)
+            break;
+        if (!processWrite(result))
+        {
+            // Send what is already queued, then close instead of answering out of order
+            // Multipart parts queued by the failed response only borrow its file, which releaseMemory frees
+            m_writeIndex = committed;
+            m_responseCount = committedCount;
+            m_bytesToSend = committedBytes;
+            m_responses[m_responseCount - 1].keepAlive = false;
+            break;
+        }
+        queueResponse();
     }
-    bool writeResult = processWrite(readResult);
-    if (!writeResult)
+
+    buildIov();
+    return readResult;
+}
+
+// 只看请求行：POST且最后一段路径以'3'开头的是注册，与generateRequest的判断一致
+bool HttpConn::needsBlockingLane() const
+{
+    if (!m_readBuffer)
+        return false;
+    const char *line = m_readBuffer + m_requestStart;
+    long available = m_readIndex - m_requestStart;
+    if (available < 5 || strncasecmp(line, "POST ", 5) != 0)
+        return false;
+    // An incomplete request line stays in the static lane, which parses what there is and waits for more
+    const char *end = static_cast<const char *>(memchr(line + 5, ' ', available - 5));
+    if (!end)
+        return false;
+    const char *slash = static_cast<const char *>(memrchr(line + 5, '/', end - line - 5));
+    return slash && slash + 1 < end && slash[1] == '3';
+}
+
+void HttpConn::rejectRequest()
+{
+    // The rest of the request is never read, so the connection cannot be reused
+    m_keepAlive = false;
+    if (!processWrite(SERVICE_UNAVAILABLE))
     {
         closeConn();
+        return;
     }
-    modFd(g_epollFd, m_socketFd, EPOLLOUT, m_triggerMode);
+    queueResponse();
+    buildIov();
+    modFd(m_epollFd, m_socketFd, EPOLLOUT, m_triggerMode);
 }
 
+void HttpConn::handleRequest(ConnectionPool* connPool)
+{
+    HttpCode result = prepareResponse(connPool);
+    if (result == NO_REQUEST)
+    {
+        modFd(m_epollFd, m_socketFd, EPOLLIN, m_triggerMode);
+        return;
+    }
+    if (result == CLOSED_CONNECTION)
+    {
+        closeConn();
+        return;
+    }
+    modFd(m_epollFd, m_socketFd, EPOLLOUT, m_triggerMode);
+}
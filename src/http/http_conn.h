@@ -19,19 +19,30 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <map>
+#include <atomic>
 
 #include "../lock/locker.h"
 #include "../mysql/connection_pool.h"
 #include "../timer/timer_list.h"
+#include "../memory/buffer_pool.h"
+#include "../cache/file_cache.h"
+#include "http_headers.h"
+#include "request_headers.h"
+#include "body_decoder.h"
+#include "upload.h"
 #include "../log/log.h"
 
 class HttpConn
 {
 public:
     static const int MAX_FILENAME_LENGTH = 200;
-    static const int MAX_READ_BUFFER_SIZE = 2048;
-    static const int MAX_WRITE_BUFFER_SIZE = 1024;
+    static const int READ_BUFFER_SIZE = 2048;      // Initial read buffer, grown up to the per-request ceiling
+    static const int MAX_WRITE_BUFFER_SIZE = 1024;     // Initial write buffer, grown when responses do not fit
+    static const int MAX_PIPELINED_RESPONSES = 16;     // Responses batched into one writev
+    static const int MAX_RANGES = 8;                   // More ranges than this and the whole file is sent
+    static const int BODY_WINDOW_SIZE = 16 * 1024;     // Read buffer space for a body that is streamed
 
     enum Method
     {
@@ -56,7 +67,14 @@ public:
         NO_RESOURCE,
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
+        NOT_MODIFIED,
+        PARTIAL_CONTENT,
+        RANGE_NOT_SATISFIABLE,
+        PAYLOAD_TOO_LARGE,
+        UPLOAD_REQUEST,
+        METRICS_REQUEST,
         INTERNAL_ERROR,
+        SERVICE_UNAVAILABLE,
         CLOSED_CONNECTION
     };
 
@@ -68,39 +86,145 @@ public:
     };
 
 public:
-    HttpConn() {}
-    ~HttpConn() {}
+    HttpConn();
+    ~HttpConn();
 
 public:
-    void init(int socketFd, const sockaddr_in &address, char *, int, int, std::string user, std::string password, std::string databaseName);
+    // sendFile: send file bodies with sendfile() from a held fd instead of mmap + writev
+    // cacheMaxAge: Cache-Control max-age of file responses, 0 makes clients revalidate every time
+    // uploadDirectory, maxUploadSize: where POST /upload stages files and its largest body, 0 disables it
+    // keepAliveTimeout, maxKeepAliveRequests: advertised in the Keep-Alive header; the connection closes
+    // after maxKeepAliveRequests responses, 0 for no limit
+    void init(int epollFd, int socketFd, const sockaddr_in &address, char *docRoot, int triggerMode, int logStatus,
+              int maxRequestSize, int sendFile, int cacheMaxAge, const char *uploadDirectory, long maxUploadSize,
+              int keepAliveTimeout, int maxKeepAliveRequests);
     void closeConn(bool realClose = true);
     void handleRequest(ConnectionPool* connPool);
+    // Whether the buffered request line is for a handler that waits on the database (register)
+    bool needsBlockingLane() const;
+    // Answers 503 without parsing the buffered request and closes after sending it
+    void rejectRequest();
     bool readFromSocket();
-    bool writeToSocket();
+    // requestBuffered: a pipelined request is already buffered and must be processed by the caller,
+    // the socket has not been re-armed for reading in that case
+    // idle: the connection stays open with nothing buffered, the keep-alive timeout applies
+    bool writeToSocket(bool &requestBuffered, bool &idle);
+
+    // Completion-based I/O: the caller moves the bytes, HttpConn only parses and tracks progress
+    bool appendReadData(const char *data, int length);
+    HttpCode prepareResponse(ConnectionPool* connPool);
+    struct iovec *getWriteIov(int &iovCount)
+    {
+        iovCount = m_iovCount;
+        return m_iov;
+    }
+    bool advanceWrite(long bytesWritten);
+    bool finishResponse();
+    // Whether the connection stays open after the queued responses (decided by the last one)
+    bool isKeepAlive() const
+    {
+        return m_responseCount > 0 ? m_responses[m_responseCount - 1].keepAlive : m_keepAlive;
+    }
+    // Between requests: no response pending and no byte of the next request received
+    bool isIdle() const
+    {
+        return m_responseCount == 0 && m_readIndex == 0;
+    }
+
     sockaddr_in *getAddress()
     {
         return &m_address;
     }
-    void initMysqlResult(ConnectionPool *connPool);
+    int getSocketFd() const
+    {
+        return m_socketFd;
+    }
+    static void initMysqlResult(ConnectionPool *connPool, int logStatus);
+    // Serializes the error responses once, before any connection is served
+    static void initResponses();
 
 
 private:
+    // 一个已生成、等待发送的响应：写缓冲区中[上一个响应的end, end)的头部，加上可选的文件正文
+    // 文件正文是mmap的映射（fileAddress），或sendfile模式下持有的文件描述符（fileFd）
+    // 来自文件缓存时两者都属于cachedFile，发送完毕后只归还引用
+    // multipart/byteranges的每个分段各占一项，只有最后一项持有文件，其余借用
+    struct QueuedResponse
+    {
+        int end;
+        char *fileAddress;
+        int fileFd;
+        long mappedSize;        // Length to munmap, the whole file
+        long fileOffset;        // Part of the file to send
+        long fileSize;
+        CachedFile *cachedFile;
+        bool ownsFile;
+        bool keepAlive;
+    };
+
     void reset();
+    void beginRequest();
+    void rebaseReadPointers(char *oldBase, char *newBase);
+    void compactReadBuffer();
+    void queuePart(long offset, long length, bool ownsFile);
+    void queueResponse();
+    void buildIov();
+    void appendIov(char *base, long length, long &skip);
+    ssize_t sendPending();
+    // Unparsed bytes of a pipelined request remain after finishResponse
+    bool hasBufferedRequest() const
+    {
+        return m_checkedIndex < m_readIndex;
+    }
     HttpCode processRead(ConnectionPool* connPool);
     bool processWrite(HttpCode result);
-    HttpCode parseRequestLine(char *text);
-    HttpCode parseHeaders(char *text);
-    HttpCode parseContent(char *text);
+    HttpCode parseRequestLine(char *text, int length);
+    HttpCode parseHeaders(char *text, int length);
+    bool wantsKeepAlive() const;
+    HttpCode beginBody();
+    HttpCode beginUpload();
+    HttpCode parseContent();
+    bool consumeBody(const char *data, int length);
+    void releaseUpload();
 
     void concatUrl(int length, const char* url);
     HttpCode generateRequest(ConnectionPool* connPool);
+    bool isNotModified(const char *etag);
+    HttpCode checkRange(const char *etag);
     char *currentLine() { return m_readBuffer + m_startLine; };
+    // Value of a request header, '\0' terminated in the read buffer; nullptr when absent
+    const char *header(HeaderId id) const { return m_headers.get(m_readBuffer + m_requestStart, id); }
     LineStatus parseLine();
 
+    void releaseFile();
     void releaseMemory();
-    bool appendResponse(const char *format, ...);
+    bool acquireReadBuffer();
+    bool reserveReadSpace(int length);
+    // Bytes that can still be read without growing the buffer or passing the ceiling
+    int readSpace() const
+    {
+        int limit = m_readCapacity - 1 < m_maxRequestSize ? m_readCapacity - 1 : m_maxRequestSize;
+        return limit - m_readIndex;
+    }
+    bool acquireWriteBuffer();
+    bool growWriteBuffer();
+    void releaseBuffers();
+    // 响应直接拼接到写缓冲区：固定的片段memcpy，数字由formatDecimal转换
+    char *reserveWrite(int length);
+    bool appendRaw(const char *data, int length);
+    template <int N>
+    bool appendLiteral(const char (&text)[N])
+    {
+        return appendRaw(text, N - 1);
+    }
+    bool appendNumber(long value);
+    bool appendError(HttpCode code);
+    const char *fileHeaders(char *buffer, int size, int &length, int &typeOffset, int &validatorOffset);
+    bool appendFileHeaders(bool validatorsOnly);
+    bool appendRangeHeaders();
     bool appendContent(const char *content);
-    bool appendStatusLine(int status, const char *title);
+    bool appendPlainText(int status, const char *text, int length);
+    bool appendStatusLine(int status);
     bool appendHeaders(int contentLength);
     bool appendContentType();
     bool appendContentLength(int contentLength);
@@ -108,22 +232,30 @@ private:
     bool appendBlankLine();
 
 public:
-    static int g_epollFd;
-    static int g_userCount;
+    static std::atomic<int> g_userCount;
 
-    MYSQL *mysql;
     int requestState;  // 0 for read, 1 for write
-    int timerFlag;
-    int isImproved;
+    int lastWorker;    // Pool worker that handled the previous task, -1 for a new connection
+    long queuedAt;     // When a pool lane queued the task, monotonic microseconds
+    unsigned int taskSequence;  // Set by the event loop for each task it stages, 0 before the first
+    bool inFlight;      // Staged or held by a pool worker until its completion arrives; the loop must not free it
+    bool closePending;  // Closed by the loop while in flight: the socket is shut down, the completion closes it
+    ClientData clientData;  // Timer node and socket info, owned by the event loop thread
 
 private:
+    int m_epollFd;
     int m_socketFd;
     sockaddr_in m_address;
-    char m_readBuffer[MAX_READ_BUFFER_SIZE];
+    // 读写缓冲区从BufferPool借用，请求处理完毕后归还
+    char *m_readBuffer;
+    int m_readCapacity;
+    int m_maxRequestSize;   // Ceiling for m_readIndex; larger requests close the connection
     long m_readIndex;
     long m_checkedIndex;
     int m_startLine;
-    char m_writeBuffer[MAX_WRITE_BUFFER_SIZE];
+    long m_requestStart;    // Where the request being parsed begins; earlier bytes are dropped on compaction
+    char *m_writeBuffer;
+    int m_writeCapacity;
     int m_writeIndex;
 
     CheckState m_checkState;
@@ -131,28 +263,49 @@ private:
     char m_realFile[MAX_FILENAME_LENGTH];
     char *m_url;
     char *m_version;
-    char *m_host;
+    RequestHeaders m_headers;   // every header line of the request being parsed
+    ByteRange m_ranges[MAX_RANGES];
+    int m_rangeCount;
+    long m_bodyOffset;      // Part of the file the response body carries
+    long m_bodyLength;
     long m_contentLength;
+    bool m_http10;          // HTTP/1.0 request: persistent only when it asks for keep-alive
     bool m_keepAlive;
+    int m_keepAliveTimeout;     // Seconds, for the Keep-Alive header
+    int m_maxKeepAliveRequests;
+    int m_requestCount;         // Responses generated on this connection
 
     char *m_fileAddress; // file content in memory
+    int m_fileFd;        // file held open for sendfile
+    CachedFile *m_cachedFile;   // file served from the shared cache
+    int m_sendFile;
+    int m_cacheMaxAge;
 
     struct stat m_fileStat;
-    struct iovec m_iov[2];
+    QueuedResponse m_responses[MAX_PIPELINED_RESPONSES + MAX_RANGES];
+    int m_responseCount;
+    struct iovec m_iov[2 * (MAX_PIPELINED_RESPONSES + MAX_RANGES)];
     int m_iovCount;
+    // sendfile模式下iovec只覆盖下一个文件正文之前的内存部分
+    int m_sendFd;           // File body to send when the iovec is empty, -1 if none
+    off_t m_sendOffset;
+    long m_sendLength;
+    bool m_bodyFollows;     // A file body follows the iovec: send the headers with MSG_MORE
     int m_isCgi;            // Indicates if POST is enabled
     char *m_requestData; // Stores request content data
-    int m_bytesToSend;
-    int m_bytesHaveSent;
+    BodyDecoder m_bodyDecoder;
+    long m_bodyStart;       // Where the body starts in the read buffer
+    bool m_retainBody;      // Keep the decoded body in the read buffer for the handler (the login/register form)
+    Upload *m_upload;       // POST /upload in progress, its parts are staged as the body arrives
+    const char *m_uploadDirectory;
+    long m_maxUploadSize;
+    long m_bytesToSend;     // Whole files and ranges can exceed 2 GiB, as the queued sizes already do
+    long m_bytesHaveSent;
     char *m_docRoot;
 
     int m_triggerMode;
     int m_logStatus;
 
-    char m_user[100];
-    char m_password[100];
-    char m_databaseName[100];
-
     // Locker m_lock;
     // std::map<std::string, std::string> m_users;
 };
@@ -0,0 +1,313 @@
+#include "http_headers.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+struct MimeType
+{
+    const char *extension;
+    const char *type;
+};
+
+static const MimeType MIME_TYPES[] = {
+    {"html", "text/html; charset=utf-8"},
+    {"htm", "text/html; charset=utf-8"},
+    {"css", "text/css"},
+    {"js", "application/javascript"},
+    {"json", "application/json"},
+    {"txt", "text/plain; charset=utf-8"},
+    {"xml", "application/xml"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"png", "image/png"},
+    {"gif", "image/gif"},
+    {"ico", "image/x-icon"},
+    {"svg", "image/svg+xml"},
+    {"webp", "image/webp"},
+    {"mp4", "video/mp4"},
+    {"webm", "video/webm"},
+    {"mp3", "audio/mpeg"},
+    {"pdf", "application/pdf"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+};
+
+const char *mimeType(const char *path)
+{
+    const char *dot = strrchr(path, '.');
+    const char *slash = strrchr(path, '/');
+    if (dot && (!slash || dot > slash))
+    {
+        for (size_t i = 0; i < sizeof(MIME_TYPES) / sizeof(MIME_TYPES[0]); ++i)
+        {
+            if (strcasecmp(dot + 1, MIME_TYPES[i].extension) == 0)
+                return MIME_TYPES[i].type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+bool isCompressible(const char *type)
+{
+    return strncmp(type, "text/", 5) == 0
+        || strcmp(type, "application/javascript") == 0
+        || strcmp(type, "application/json") == 0
+        || strcmp(type, "application/xml") == 0
+        || strcmp(type, "image/svg+xml") == 0;
+}
+
+int parseAcceptEncoding(const char *acceptEncoding)
+{
+    int accepted = 0;
+    int refused = 0;
+    bool any = false;
+    const char *p = acceptEncoding;
+    while (*p)
+    {
+        p += strspn(p, " \t,");
+        size_t length = strcspn(p, " \t;,");
+        if (length == 0)
+            break;
+        const char *name = p;
+        p += length;
+
+        // Only q=0 matters: it refuses the coding, any other weight accepts it
+        bool zero = false;
+        p += strspn(p, " \t");
+        if (*p == ';')
+        {
+            const char *q = strstr(p, "q=");
+            const char *next = strchr(p, ',');
+            if (q && (!next || q < next))
+                zero = strtod(q + 2, nullptr) == 0.0;
+            p = next ? next : p + strlen(p);
+        }
+
+        int encoding = 0;
+        if (length == 4 && strncasecmp(name, "gzip", 4) == 0)
+            encoding = ENCODING_GZIP;
+        else if (length == 2 && strncasecmp(name, "br", 2) == 0)
+            encoding = ENCODING_BR;
+        else if (length == 1 && name[0] == '*')
+            any = !zero;
+
+        if (zero)
+            refused |= encoding;
+        else
+            accepted |= encoding;
+    }
+    if (any)
+        accepted |= ENCODING_GZIP | ENCODING_BR;
+    return accepted & ~refused;
+}
+
+const char *encodingName(int encoding)
+{
+    return encoding == ENCODING_BR ? "br" : "gzip";
+}
+
+const char *encodingExtension(int encoding)
+{
+    return encoding == ENCODING_BR ? ".br" : ".gz";
+}
+
+// 每次处理两位数字，除法次数减半
+static const char DIGIT_PAIRS[] =
+    "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+    "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+int formatDecimal(unsigned long value, char *buffer)
+{
+    char digits[20];
+    char *p = digits + sizeof(digits);
+    while (value >= 100)
+    {
+        int pair = (value % 100) * 2;
+        value /= 100;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10)
+    {
+        *--p = DIGIT_PAIRS[value * 2 + 1];
+        *--p = DIGIT_PAIRS[value * 2];
+    }
+    else
+    {
+        *--p = '0' + value;
+    }
+    int length = digits + sizeof(digits) - p;
+    memcpy(buffer, p, length);
+    return length;
+}
+
+int formatHttpDate(time_t t, char *buffer, int size)
+{
+    struct tm gmt;
+    gmtime_r(&t, &gmt);
+    return strftime(buffer, size, "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+}
+
+bool parseHttpDate(const char *text, time_t &t)
+{
+    struct tm gmt;
+    memset(&gmt, 0, sizeof(gmt));
+    const char *end = strptime(text, "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    if (!end)
+        return false;
+    t = timegm(&gmt);
+    return t != (time_t)-1;
+}
+
+int formatEntityTag(const struct stat &fileStat, char *buffer, int size)
+{
+    return snprintf(buffer, size, "\"%lx-%lx\"", (unsigned long)fileStat.st_mtime, (unsigned long)fileStat.st_size);
+}
+
+int formatFileHeaders(const char *path, const struct stat &fileStat, int encoding, int cacheMaxAge,
+                      char *buffer, int size, int &typeOffset, int &validatorOffset)
+{
+    const char *type = mimeType(path);
+    char etag[48];
+    char lastModified[48];
+    formatEntityTag(fileStat, etag, sizeof(etag));
+    formatHttpDate(fileStat.st_mtime, lastModified, sizeof(lastModified));
+
+    typeOffset = snprintf(buffer, size, "Content-Length:%ld\r\n", (long)fileStat.st_size);
+    validatorOffset = typeOffset + snprintf(buffer + typeOffset, size - typeOffset, "Content-Type:%s\r\n", type);
+    if (encoding != ENCODING_IDENTITY && validatorOffset < size)
+        validatorOffset += snprintf(buffer + validatorOffset, size - validatorOffset, "Content-Encoding:%s\r\n",
+                                    encodingName(encoding));
+    // Caches must keep the encoded and identity variants apart
+    if ((encoding != ENCODING_IDENTITY || isCompressible(type)) && validatorOffset < size)
+        validatorOffset += snprintf(buffer + validatorOffset, size - validatorOffset, "Vary:Accept-Encoding\r\n");
+    if (validatorOffset < size)
+        validatorOffset += snprintf(buffer + validatorOffset, size - validatorOffset, "Accept-Ranges:bytes\r\n");
+    if (validatorOffset >= size)
+        return -1;
+
+    int length;
+    if (cacheMaxAge > 0)
+        length = snprintf(buffer + validatorOffset, size - validatorOffset,
+                          "ETag:%s\r\nLast-Modified:%s\r\nCache-Control:public, max-age=%d\r\n",
+                          etag, lastModified, cacheMaxAge);
+    else
+        length = snprintf(buffer + validatorOffset, size - validatorOffset,
+                          "ETag:%s\r\nLast-Modified:%s\r\nCache-Control:no-cache\r\n", etag, lastModified);
+    if (length >= size - validatorOffset)
+        return -1;
+    return validatorOffset + length;
+}
+
+bool entityTagMatches(const char *ifNoneMatch, const char *etag)
+{
+    const char *p = ifNoneMatch + strspn(ifNoneMatch, " \t");
+    if (p[0] == '*')
+        return true;
+
+    // Weak comparison: a W/ prefix on either side is ignored
+    if (strncmp(etag, "W/", 2) == 0)
+        etag += 2;
+    size_t etagLength = strlen(etag);
+    while (*p)
+    {
+        p += strspn(p, " \t,");
+        if (strncmp(p, "W/", 2) == 0)
+            p += 2;
+        if (*p != '"')
+            break;
+        const char *close = strchr(p + 1, '"');
+        if (!close)
+            break;
+        size_t length = close - p + 1;
+        if (length == etagLength && strncmp(p, etag, length) == 0)
+            return true;
+        p = close + 1;
+    }
+    return false;
+}
+
+// 解析一个非负整数，要求至少有一位数字
+static bool parseOffset(const char *&p, long &value)
+{
+    if (*p < '0' || *p > '9')
+        return false;
+    char *end;
+    value = strtol(p, &end, 10);
+    p = end;
+    return value >= 0 && value != LONG_MAX;
+}
+
+int parseByteRanges(const char *spec, long size, ByteRange *ranges, int maxRanges)
+{
+    if (strncasecmp(spec, "bytes=", 6) != 0)
+        return -1;
+
+    const char *p = spec + 6;
+    int count = 0;
+    while (true)
+    {
+        p += strspn(p, " \t");
+        long first, last;
+        bool satisfiable;
+        if (*p == '-')
+        {
+            // Suffix range: the last n bytes
+            ++p;
+            long length;
+            if (!parseOffset(p, length))
+                return -1;
+            satisfiable = length > 0;
+            first = length < size ? size - length : 0;
+            last = size - 1;
+        }
+        else
+        {
+            if (!parseOffset(p, first) || *p++ != '-')
+                return -1;
+            last = size - 1;
+            if (*p >= '0' && *p <= '9')
+            {
+                if (!parseOffset(p, last) || last < first)
+                    return -1;
+                if (last > size - 1)
+                    last = size - 1;
+            }
+            satisfiable = first < size;
+        }
+
+        if (satisfiable)
+        {
+            if (count == maxRanges)
+                return -1;
+            ranges[count].first = first;
+            ranges[count].last = last;
+            ++count;
+        }
+
+        p += strspn(p, " \t");
+        if (*p == '\0')
+            break;
+        if (*p++ != ',')
+            return -1;
+    }
+    return count;
+}
+
+bool ifRangeMatches(const char *ifRange, const char *etag, time_t lastModified)
+{
+    // Weak tags never match: the bytes of the two representations may differ
+    if (ifRange[0] == '"')
+    {
+        size_t length = strlen(etag);
+        return strncmp(ifRange, etag, length) == 0 && ifRange[length] == '\0';
+    }
+    if (strncmp(ifRange, "W/", 2) == 0)
+        return false;
+
+    time_t date;
+    return parseHttpDate(ifRange, date) && date == lastModified;
+}
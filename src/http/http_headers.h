@@ -0,0 +1,65 @@
+#ifndef HTTP_HEADERS_H
+#define HTTP_HEADERS_H
+
+#include <sys/stat.h>
+#include <time.h>
+
+// 静态文件响应头的生成，以及条件请求（If-None-Match / If-Modified-Since）的判断
+// 文件缓存在加载时生成一次，未缓存的文件在每次请求时生成
+
+// Content-Type for a file name, application/octet-stream when the extension is unknown
+const char *mimeType(const char *path);
+// Text-like types worth compressing; images, video and fonts are already compressed
+bool isCompressible(const char *type);
+
+// Content codings, also used as bit flags for what a client accepts
+enum ContentEncoding
+{
+    ENCODING_IDENTITY = 0,
+    ENCODING_GZIP = 1,
+    ENCODING_BR = 2
+};
+// Accept-Encoding: the codings we support that the client accepts (q=0 excludes one, "*" means any)
+int parseAcceptEncoding(const char *acceptEncoding);
+// Token for Content-Encoding and the file extension of a precompressed sibling
+const char *encodingName(int encoding);
+const char *encodingExtension(int encoding);
+
+// Decimal digits of value at buffer, which must have room for 20; returns the length, nothing is terminated
+int formatDecimal(unsigned long value, char *buffer);
+
+// RFC 7231 IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+int formatHttpDate(time_t t, char *buffer, int size);
+bool parseHttpDate(const char *text, time_t &t);
+
+// Strong validator derived from the modification time and size
+int formatEntityTag(const struct stat &fileStat, char *buffer, int size);
+
+// Header lines of a 200 response for the file, each ending in CRLF, in three parts:
+// Content-Length; Content-Type, Content-Encoding, Vary and Accept-Ranges (from typeOffset); the validators
+// ETag, Last-Modified and Cache-Control (from validatorOffset). A 206 replaces the first part, a 304 sends
+// only the last. path names the requested file (it picks the type), fileStat describes the bytes sent,
+// which for an encoded variant are the compressed ones.
+// cacheMaxAge > 0 allows caching for that many seconds, otherwise clients must revalidate.
+int formatFileHeaders(const char *path, const struct stat &fileStat, int encoding, int cacheMaxAge,
+                      char *buffer, int size, int &typeOffset, int &validatorOffset);
+
+// If-None-Match: "*" or a list of entity tags, compared weakly as RFC 7232 requires for GET
+bool entityTagMatches(const char *ifNoneMatch, const char *etag);
+
+// Inclusive byte range of a file
+struct ByteRange
+{
+    long first;
+    long last;
+};
+
+// Range: bytes=a-b, a-, -n, comma separated. Returns the number of satisfiable ranges stored in ranges
+// (0 means 416), or -1 when the header is malformed or asks for more than maxRanges ranges, in which
+// case it is ignored and the whole file is sent.
+int parseByteRanges(const char *spec, long size, ByteRange *ranges, int maxRanges);
+
+// If-Range: an entity tag (strong comparison) or an HTTP date that must equal Last-Modified
+bool ifRangeMatches(const char *ifRange, const char *etag, time_t lastModified);
+
+#endif
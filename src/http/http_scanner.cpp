@@ -0,0 +1,160 @@
+#include "http_scanner.h"
+
+#include <string.h>
+#include <strings.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCANNER_X86 1
+#endif
+
+typedef size_t (*FindPairFunction)(const char *data, size_t length, char first, char second);
+
+static size_t findPairScalar(const char *data, size_t length, char first, char second)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (data[i] == first || data[i] == second)
+            return i;
+    }
+    return length;
+}
+
+#ifdef HTTP_SCANNER_X86
+// 每次比较16字节，只对完整的块做非对齐加载，不会读出缓冲区
+__attribute__((target("sse2")))
+static size_t findPairSse2(const char *data, size_t length, char first, char second)
+{
+    const __m128i a = _mm_set1_epi8(first);
+    const __m128i b = _mm_set1_epi8(second);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, a), _mm_cmpeq_epi8(chunk, b)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + findPairScalar(data + i, length - i, first, second);
+}
+
+__attribute__((target("avx2")))
+static size_t findPairAvx2(const char *data, size_t length, char first, char second)
+{
+    const __m256i a = _mm256_set1_epi8(first);
+    const __m256i b = _mm256_set1_epi8(second);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, a), _mm256_cmpeq_epi8(chunk, b)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    // The tail of most header lines is shorter than a 32-byte block. findPairSse2 is legacy SSE
+    // code: entering it with the upper ymm halves dirty costs a state transition on every line
+    _mm256_zeroupper();
+    return i + findPairSse2(data + i, length - i, first, second);
+}
+#endif
+
+struct Scanner
+{
+    FindPairFunction findPair;
+    const char *name;
+};
+
+static Scanner selectScanner()
+{
+#ifdef HTTP_SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return Scanner{findPairAvx2, "avx2"};
+    if (__builtin_cpu_supports("sse2"))
+        return Scanner{findPairSse2, "sse2"};
+#endif
+    return Scanner{findPairScalar, "scalar"};
+}
+
+static const Scanner s_scanner = selectScanner();
+
+size_t findLineEnd(const char *data, size_t length)
+{
+    return s_scanner.findPair(data, length, '\r', '\n');
+}
+
+size_t findBlank(const char *data, size_t length)
+{
+    return s_scanner.findPair(data, length, ' ', '\t');
+}
+
+const char *scannerName()
+{
+    return s_scanner.name;
+}
+
+static const char *const HEADER_NAMES[HEADER_COUNT] = {
+    "",
+    "Accept",
+    "Accept-Encoding",
+    "Accept-Language",
+    "Authorization",
+    "Cache-Control",
+    "Connection",
+    "Content-Length",
+    "Content-Type",
+    "Cookie",
+    "Expect",
+    "Host",
+    "If-Modified-Since",
+    "If-None-Match",
+    "If-Range",
+    "Keep-Alive",
+    "Origin",
+    "Pragma",
+    "Range",
+    "Referer",
+    "Transfer-Encoding",
+    "Upgrade",
+    "User-Agent",
+};
+
+static const unsigned HEADER_TABLE_SIZE = 64;
+
+// 由长度以及首、中、尾三个字符（转为小写）组成；系数是对上面的名称离线搜索得到的，
+// 保证它们落在不同的槽位。增加名称时需要重新确认没有冲突
+static unsigned headerHash(const char *name, size_t length)
+{
+    return (length + 25 * (name[0] | 0x20) + (name[length / 2] | 0x20) + (name[length - 1] | 0x20)) &
+           (HEADER_TABLE_SIZE - 1);
+}
+
+struct HeaderSlots
+{
+    unsigned char slots[HEADER_TABLE_SIZE];
+
+    HeaderSlots()
+    {
+        memset(slots, HEADER_UNKNOWN, sizeof(slots));
+        for (int id = HEADER_UNKNOWN + 1; id < HEADER_COUNT; ++id)
+            slots[headerHash(HEADER_NAMES[id], strlen(HEADER_NAMES[id]))] = id;
+    }
+};
+
+static const HeaderSlots s_headerSlots;
+
+HeaderId classifyHeader(const char *name, size_t length)
+{
+    if (length == 0)
+        return HEADER_UNKNOWN;
+    int id = s_headerSlots.slots[headerHash(name, length)];
+    const char *candidate = HEADER_NAMES[id];
+    if (id == HEADER_UNKNOWN || strlen(candidate) != length || strncasecmp(name, candidate, length) != 0)
+        return HEADER_UNKNOWN;
+    return static_cast<HeaderId>(id);
+}
+
+const char *headerName(HeaderId id)
+{
+    return HEADER_NAMES[id];
+}
@@ -0,0 +1,49 @@
+#ifndef HTTP_SCANNER_H
+#define HTTP_SCANNER_H
+
+#include <stddef.h>
+
+// 请求解析用的字节扫描：启动时按CPU选择AVX2（32字节）、SSE2（16字节）或逐字节的实现
+// 以及请求头名称的完美哈希分类
+
+// Offset of the first '\r' or '\n' in data, length when there is none
+size_t findLineEnd(const char *data, size_t length);
+// Offset of the first ' ' or '\t' in data, length when there is none
+size_t findBlank(const char *data, size_t length);
+// Name of the implementation picked for this CPU
+const char *scannerName();
+
+// Request headers known to the server; the rest are HEADER_UNKNOWN
+enum HeaderId
+{
+    HEADER_UNKNOWN = 0,
+    HEADER_ACCEPT,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_ACCEPT_LANGUAGE,
+    HEADER_AUTHORIZATION,
+    HEADER_CACHE_CONTROL,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_CONTENT_TYPE,
+    HEADER_COOKIE,
+    HEADER_EXPECT,
+    HEADER_HOST,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_IF_NONE_MATCH,
+    HEADER_IF_RANGE,
+    HEADER_KEEP_ALIVE,
+    HEADER_ORIGIN,
+    HEADER_PRAGMA,
+    HEADER_RANGE,
+    HEADER_REFERER,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_UPGRADE,
+    HEADER_USER_AGENT,
+    HEADER_COUNT
+};
+
+// Case-insensitive lookup of a header name (without the colon): one hash, one comparison
+HeaderId classifyHeader(const char *name, size_t length);
+const char *headerName(HeaderId id);
+
+#endif
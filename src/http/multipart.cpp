@@ -0,0 +1,221 @@
+#include "multipart.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+static const int MAX_PART_HEADER_BYTES = 8192;
+
+MultipartParser::MultipartParser()
+    : m_state(STATE_ERROR)
+    , m_delimiterLength(0)
+    , m_matched(0)
+    , m_lineLength(0)
+    , m_headerBytes(0)
+{
+    m_name[0] = '\0';
+    m_filename[0] = '\0';
+}
+
+bool MultipartParser::init(const char *contentType)
+{
+    m_state = STATE_ERROR;
+    if (strncasecmp(contentType, "multipart/form-data", 19) != 0)
+        return false;
+
+    char boundary[MAX_BOUNDARY_LENGTH + 1];
+    if (!parameter(contentType, "boundary", boundary, sizeof(boundary)) || boundary[0] == '\0')
+        return false;
+
+    m_delimiterLength = snprintf(m_delimiter, sizeof(m_delimiter), "\r\n--%s", boundary);
+    // The body normally starts with the delimiter itself: treat it as preceded by a CRLF
+    m_matched = 2;
+    m_state = STATE_PREAMBLE;
+    return true;
+}
+
+// 在内容中寻找分隔符，分隔符之前的字节交给处理者（前言部分直接丢弃）
+// 输入末尾可能是分隔符的开头：这些字节先不交出，由m_matched记住，下一段输入再判断
+bool MultipartParser::scanContent(const char *data, int length, int &position, MultipartHandler *handler)
+{
+    bool emit = m_state == STATE_DATA;
+    int i = position;
+    while (i < length)
+    {
+        if (m_matched > 0)
+        {
+            while (i < length && m_matched < m_delimiterLength && data[i] == m_delimiter[m_matched])
+            {
+                ++i;
+                ++m_matched;
+            }
+            if (m_matched == m_delimiterLength)
+            {
+                m_matched = 0;
+                if (emit && !handler->partEnd())
+                    return false;
+                m_state = STATE_DELIMITER_END;
+                break;
+            }
+            if (i == length)
+                break;
+            // Not a delimiter after all: what was held back is content. The boundary contains no
+            // '\r', so a new match can only start at the mismatching byte, examined below
+            if (emit && !handler->partData(m_delimiter, m_matched))
+                return false;
+            m_matched = 0;
+        }
+
+        const char *cr = static_cast<const char *>(memchr(data + i, '\r', length - i));
+        int end = cr ? cr - data : length;
+        if (end > i && emit && !handler->partData(data + i, end - i))
+            return false;
+        i = end;
+        if (cr)
+        {
+            m_matched = 1;
+            ++i;
+        }
+    }
+    position = i;
+    return true;
+}
+
+int MultipartParser::contentPrefix(const char *data, int length) const
+{
+    const char *p = data;
+    const char *end = data + length;
+    while ((p = static_cast<const char *>(memchr(p, '\r', end - p))) != nullptr)
+    {
+        int compare = end - p < m_delimiterLength ? end - p : m_delimiterLength;
+        if (memcmp(p, m_delimiter, compare) == 0)
+            return p - data;
+        ++p;
+    }
+    return length;
+}
+
+// 从"; key=value"形式的参数中取出value，去掉引号
+bool MultipartParser::parameter(const char *line, const char *key, char *value, int size)
+{
+    int keyLength = strlen(key);
+    for (const char *p = strchr(line, ';'); p; p = strchr(p, ';'))
+    {
+        ++p;
+        p += strspn(p, " \t");
+        if (strncasecmp(p, key, keyLength) != 0 || p[keyLength] != '=')
+            continue;
+
+        p += keyLength + 1;
+        int length = 0;
+        if (*p == '"')
+        {
+            for (++p; *p && *p != '"'; ++p)
+            {
+                if (*p == '\\' && p[1])
+                    ++p;
+                if (length == size - 1)
+                    return false;
+                value[length++] = *p;
+            }
+        }
+        else
+        {
+            length = strcspn(p, "; \t");
+            if (length >= size)
+                return false;
+            memcpy(value, p, length);
+        }
+        value[length] = '\0';
+        return true;
+    }
+    return false;
+}
+
+void MultipartParser::headerLine()
+{
+    m_line[m_lineLength] = '\0';
+    // Only the disposition matters; Content-Type and the rest of a part's headers are ignored
+    if (strncasecmp(m_line, "Content-Disposition:", 20) == 0)
+    {
+        if (!parameter(m_line, "name", m_name, sizeof(m_name)))
+            m_name[0] = '\0';
+        if (!parameter(m_line, "filename", m_filename, sizeof(m_filename)))
+            m_filename[0] = '\0';
+    }
+}
+
+MultipartParser::Status MultipartParser::feed(const char *data, int length, MultipartHandler *handler)
+{
+    int i = 0;
+    while (i < length && m_state != STATE_ERROR && m_state != STATE_EPILOGUE)
+    {
+        if (m_state == STATE_PREAMBLE || m_state == STATE_DATA)
+        {
+            if (!scanContent(data, length, i, handler))
+                m_state = STATE_ERROR;
+            continue;
+        }
+
+        char c = data[i++];
+        switch (m_state)
+        {
+        case STATE_DELIMITER_END:
+            if (c == '-')
+                m_state = STATE_CLOSE_DASH;
+            else if (c == '\r')
+                m_state = STATE_DELIMITER_LF;
+            else if (c != ' ' && c != '\t')
+                m_state = STATE_ERROR;
+            break;
+        case STATE_CLOSE_DASH:
+            m_state = c == '-' ? STATE_EPILOGUE : STATE_ERROR;
+            break;
+        case STATE_DELIMITER_LF:
+            if (c != '\n')
+            {
+                m_state = STATE_ERROR;
+                break;
+            }
+            m_state = STATE_HEADER;
+            m_lineLength = 0;
+            m_headerBytes = 0;
+            m_name[0] = '\0';
+            m_filename[0] = '\0';
+            break;
+        case STATE_HEADER:
+            if (c == '\r')
+                m_state = STATE_HEADER_LF;
+            else if (m_lineLength == MAX_HEADER_LINE - 1 || ++m_headerBytes > MAX_PART_HEADER_BYTES)
+                m_state = STATE_ERROR;
+            else
+                m_line[m_lineLength++] = c;
+            break;
+        case STATE_HEADER_LF:
+            if (c != '\n')
+            {
+                m_state = STATE_ERROR;
+            }
+            else if (m_lineLength == 0)
+            {
+                // Blank line: the part's content follows
+                m_state = handler->partBegin(m_name, m_filename) ? STATE_DATA : STATE_ERROR;
+                m_matched = 0;
+            }
+            else
+            {
+                headerLine();
+                m_lineLength = 0;
+                m_state = STATE_HEADER;
+            }
+            break;
+        default:
+            m_state = STATE_ERROR;
+            break;
+        }
+    }
+
+    if (m_state == STATE_ERROR)
+        return MULTIPART_ERROR;
+    return m_state == STATE_EPILOGUE ? MULTIPART_DONE : MULTIPART_MORE;
+}
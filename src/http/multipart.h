@@ -0,0 +1,75 @@
+#ifndef MULTIPART_H
+#define MULTIPART_H
+
+// multipart/form-data（RFC 7578）的增量解析：正文按到达的顺序分段送入，
+// 各部分的头部被解析，部分的内容原样交给处理者，分隔符跨越两段数据时也能识别
+
+class MultipartHandler
+{
+public:
+    virtual ~MultipartHandler() {}
+    // filename is empty for a plain form field; returning false aborts the parse
+    virtual bool partBegin(const char *name, const char *filename) = 0;
+    virtual bool partData(const char *data, int length) = 0;
+    virtual bool partEnd() = 0;
+};
+
+class MultipartParser
+{
+public:
+    static const int MAX_BOUNDARY_LENGTH = 70;      // RFC 2046
+    static const int MAX_HEADER_LINE = 1024;
+    static const int MAX_NAME_LENGTH = 256;
+
+    enum Status
+    {
+        MULTIPART_MORE,
+        MULTIPART_DONE,     // The closing delimiter was seen; anything after it is ignored
+        MULTIPART_ERROR
+    };
+
+    MultipartParser();
+
+    // Takes the boundary from a Content-Type header value; false when it is not multipart/form-data
+    bool init(const char *contentType);
+    Status feed(const char *data, int length, MultipartHandler *handler);
+
+    // Inside a part's content with nothing held back: bytes up to the next delimiter may bypass feed()
+    bool inData() const
+    {
+        return m_state == STATE_DATA && m_matched == 0;
+    }
+    // How many leading bytes of data are certainly content, i.e. cannot belong to a delimiter
+    int contentPrefix(const char *data, int length) const;
+
+private:
+    enum State
+    {
+        STATE_PREAMBLE,
+        STATE_DATA,
+        STATE_DELIMITER_END,    // After a delimiter: "--" closes the body, CRLF starts a part
+        STATE_CLOSE_DASH,
+        STATE_DELIMITER_LF,
+        STATE_HEADER,
+        STATE_HEADER_LF,
+        STATE_EPILOGUE,
+        STATE_ERROR
+    };
+
+    bool scanContent(const char *data, int length, int &position, MultipartHandler *handler);
+    void headerLine();
+    static bool parameter(const char *line, const char *key, char *value, int size);
+
+private:
+    State m_state;
+    char m_delimiter[MAX_BOUNDARY_LENGTH + 5];  // CRLF "--" boundary
+    int m_delimiterLength;
+    int m_matched;              // Delimiter bytes matched at the end of the previous input
+    char m_line[MAX_HEADER_LINE];
+    int m_lineLength;
+    int m_headerBytes;          // Header bytes of the current part, bounded
+    char m_name[MAX_NAME_LENGTH];
+    char m_filename[MAX_NAME_LENGTH];
+};
+
+#endif
@@ -0,0 +1,41 @@
+#include "request_headers.h"
+
+#include <string.h>
+#include <strings.h>
+
+void RequestHeaders::clear()
+{
+    m_count = 0;
+    memset(m_index, 0, sizeof(m_index));
+}
+
+bool RequestHeaders::add(HeaderId id, int nameOffset, int nameLength, int valueOffset, int valueLength)
+{
+    if (m_count == MAX_HEADERS)
+        return false;
+    Entry &entry = m_entries[m_count++];
+    entry.id = id;
+    entry.nameOffset = nameOffset;
+    entry.nameLength = nameLength;
+    entry.valueOffset = valueOffset;
+    entry.valueLength = valueLength;
+    if (id != HEADER_UNKNOWN && m_index[id] == 0)
+        m_index[id] = m_count;
+    return true;
+}
+
+const char *RequestHeaders::find(const char *base, const char *name, int *length) const
+{
+    int nameLength = strlen(name);
+    for (int i = 0; i < m_count; ++i)
+    {
+        const Entry &entry = m_entries[i];
+        if (entry.nameLength == nameLength && strncasecmp(base + entry.nameOffset, name, nameLength) == 0)
+        {
+            if (length)
+                *length = entry.valueLength;
+            return base + entry.valueOffset;
+        }
+    }
+    return nullptr;
+}
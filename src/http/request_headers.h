@@ -0,0 +1,65 @@
+#ifndef REQUEST_HEADERS_H
+#define REQUEST_HEADERS_H
+
+#include "http_scanner.h"
+
+// 请求头索引：只记录名称和值在请求中的位置，不复制也不分配内存
+// 位置相对于请求的起始处，读缓冲区扩容或压缩移动时不需要修正
+// 值在缓冲区中以'\0'结尾，可以直接当作C字符串使用
+class RequestHeaders
+{
+public:
+    static const int MAX_HEADERS = 64;     // More header lines make the request a bad one
+
+    struct Entry
+    {
+        HeaderId id;
+        int nameOffset;
+        int nameLength;
+        int valueOffset;
+        int valueLength;
+    };
+
+    RequestHeaders()
+    {
+        clear();
+    }
+
+    void clear();
+    // Returns false when the table is full
+    bool add(HeaderId id, int nameOffset, int nameLength, int valueOffset, int valueLength);
+
+    // Value of a known header (its first occurrence), nullptr when absent; base is the start of the request
+    const char *get(const char *base, HeaderId id, int *length = nullptr) const
+    {
+        int index = m_index[id];
+        if (index == 0)
+            return nullptr;
+        const Entry &entry = m_entries[index - 1];
+        if (length)
+            *length = entry.valueLength;
+        return base + entry.valueOffset;
+    }
+    bool has(HeaderId id) const
+    {
+        return m_index[id] != 0;
+    }
+    // Any header by name, case-insensitive; a linear scan, meant for headers without a HeaderId
+    const char *find(const char *base, const char *name, int *length = nullptr) const;
+
+    int count() const
+    {
+        return m_count;
+    }
+    const Entry &entry(int i) const
+    {
+        return m_entries[i];
+    }
+
+private:
+    Entry m_entries[MAX_HEADERS];
+    int m_count;
+    unsigned char m_index[HEADER_COUNT];    // HeaderId -> entry index + 1, 0 when absent
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include "upload.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../log/log.h"
+#include "../memory/buffer_pool.h"
+#include "../metrics/metrics.h"
+
+Upload::Upload(const char *directory, int logStatus)
+    : m_directory(directory)
+    , m_logStatus(logStatus)
+    , m_done(false)
+    , m_ioFailed(false)
+    , m_committed(false)
+    , m_fileCount(0)
+    , m_fieldCount(0)
+    , m_fileFd(-1)
+    , m_peekBuffer(nullptr)
+    , m_peekCapacity(0)
+    , m_spliceFailed(false)
+{
+    m_pipe[0] = -1;
+    m_pipe[1] = -1;
+    Metrics::getInstance()->add(METRIC_UPLOADS_ACTIVE);
+}
+
+Upload::~Upload()
+{
+    if (m_fileFd != -1)
+        close(m_fileFd);
+    if (m_pipe[0] != -1)
+    {
+        close(m_pipe[0]);
+        close(m_pipe[1]);
+    }
+    if (m_peekBuffer)
+        BufferPool::getInstance()->release(m_peekBuffer, m_peekCapacity);
+
+    if (!m_committed)
+    {
+        for (int i = 0; i < m_fileCount; ++i)
+            unlink(m_files[i].path);
+        Metrics::getInstance()->add(METRIC_UPLOADS_FAILED);
+    }
+    Metrics::getInstance()->add(METRIC_UPLOADS_ACTIVE, -1);
+}
+
+bool Upload::begin(const char *contentType)
+{
+    return m_parser.init(contentType);
+}
+
+bool Upload::feed(const char *data, int length)
+{
+    MultipartParser::Status status = m_parser.feed(data, length, this);
+    if (status == MultipartParser::MULTIPART_ERROR)
+        return false;
+    if (status == MultipartParser::MULTIPART_DONE)
+        m_done = true;
+    return true;
+}
+
+bool Upload::partBegin(const char *name, const char *filename)
+{
+    if (filename[0] == '\0')
+    {
+        ++m_fieldCount;
+        return true;
+    }
+    if (m_fileCount == MAX_FILES)
+        return false;
+
+    // 暂存文件名由服务器生成，客户端给出的文件名只出现在回复中
+    StagedFile &file = m_files[m_fileCount];
+    snprintf(file.path, sizeof(file.path), "%s/upload.XXXXXX", m_directory);
+    m_fileFd = mkostemp(file.path, O_CLOEXEC);
+    if (m_fileFd < 0)
+    {
+        LOG_ERROR(m_logStatus, "upload: cannot create %s: %s", file.path, strerror(errno));
+        m_ioFailed = true;
+        return false;
+    }
+    snprintf(file.name, sizeof(file.name), "%s", name);
+    snprintf(file.filename, sizeof(file.filename), "%s", filename);
+    file.size = 0;
+    ++m_fileCount;
+    Metrics::getInstance()->add(METRIC_UPLOAD_FILES);
+    return true;
+}
+
+bool Upload::partData(const char *data, int length)
+{
+    if (m_fileFd == -1)
+        return true;
+    if (!writeAll(data, length))
+        return false;
+    m_files[m_fileCount - 1].size += length;
+    Metrics::getInstance()->add(METRIC_UPLOAD_BYTES, length);
+    return true;
+}
+
+bool Upload::partEnd()
+{
+    if (m_fileFd != -1)
+    {
+        close(m_fileFd);
+        m_fileFd = -1;
+    }
+    return true;
+}
+
+bool Upload::writeAll(const char *data, int length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(m_fileFd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR(m_logStatus, "upload: write failed: %s", strerror(errno));
+            m_ioFailed = true;
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+long Upload::spliceFrom(int socketFd, long maxLength)
+{
+    if (m_spliceFailed || m_fileFd == -1 || !m_parser.inData())
+        return 0;
+    if (!m_peekBuffer)
+    {
+        m_peekBuffer = BufferPool::getInstance()->acquire(PEEK_SIZE, m_peekCapacity);
+        if (!m_peekBuffer || pipe2(m_pipe, O_NONBLOCK | O_CLOEXEC) < 0)
+        {
+            m_pipe[0] = m_pipe[1] = -1;
+            m_spliceFailed = true;
+            return 0;
+        }
+    }
+
+    long moved = 0;
+    while (moved < maxLength)
+    {
+        // The bytes are only looked at here to find where the content ends; what reaches the file
+        // is moved by the kernel page by page
+        int want = maxLength - moved < PEEK_SIZE ? (int)(maxLength - moved) : PEEK_SIZE;
+        ssize_t peeked = recv(socketFd, m_peekBuffer, want, MSG_PEEK | MSG_DONTWAIT);
+        if (peeked <= 0)
+            break;
+        int content = m_parser.contentPrefix(m_peekBuffer, peeked);
+
+        int left = content;
+        while (left > 0)
+        {
+            ssize_t inPipe = splice(socketFd, nullptr, m_pipe[1], nullptr, left, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (inPipe <= 0)
+            {
+                // Nothing moved yet on a socket that does not support it: fall back to feed()
+                if (inPipe < 0 && errno == EINVAL && moved == 0 && left == content)
+                {
+                    m_spliceFailed = true;
+                    return 0;
+                }
+                LOG_ERROR(m_logStatus, "upload: splice from socket failed: %s", strerror(errno));
+                return -1;
+            }
+            for (ssize_t drained = 0; drained < inPipe; )
+            {
+                ssize_t written = splice(m_pipe[0], nullptr, m_fileFd, nullptr, inPipe - drained, SPLICE_F_MOVE);
+                if (written <= 0)
+                {
+                    LOG_ERROR(m_logStatus, "upload: splice to file failed: %s", strerror(errno));
+                    m_ioFailed = true;
+                    return -1;
+                }
+                drained += written;
+            }
+            left -= inPipe;
+        }
+
+        moved += content;
+        m_files[m_fileCount - 1].size += content;
+        Metrics::getInstance()->add(METRIC_UPLOAD_BYTES, content);
+        Metrics::getInstance()->add(METRIC_UPLOAD_SPLICED_BYTES, content);
+        // A delimiter, or what may be the start of one, is next
+        if (content < peeked)
+            break;
+    }
+    return moved;
+}
+
+void Upload::commit()
+{
+    m_committed = true;
+    Metrics::getInstance()->add(METRIC_UPLOADS_COMPLETED);
+}
+
+int Upload::formatSummary(char *buffer, int size) const
+{
+    int length = 0;
+    for (int i = 0; i < m_fileCount; ++i)
+    {
+        // Only the staged file's own name, the directory stays private
+        const char *staged = strrchr(m_files[i].path, '/');
+        length += snprintf(buffer + length, size - length, "file %s \"%s\" %ld bytes staged as %s\n",
+                           m_files[i].name, m_files[i].filename, m_files[i].size, staged ? staged + 1 : m_files[i].path);
+        if (length >= size)
+            return -1;
+    }
+    length += snprintf(buffer + length, size - length, "fields %d\n", m_fieldCount);
+    return length < size ? length : -1;
+}
@@ -0,0 +1,79 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <sys/types.h>
+
+#include "multipart.h"
+
+// 一次multipart/form-data上传：文件部分写入暂存目录下新建的文件（upload.XXXXXX），普通字段只计数
+// 没有成功完成的上传在析构时删除已写入的文件
+class Upload : public MultipartHandler
+{
+public:
+    static const int MAX_FILES = 16;                // File parts per request
+    static const int PEEK_SIZE = 64 * 1024;         // Socket bytes examined per splice, one pipe's worth
+
+    Upload(const char *directory, int logStatus);
+    ~Upload();
+
+    // contentType: the request's Content-Type; false when it is not multipart/form-data with a boundary
+    bool begin(const char *contentType);
+
+    // Decoded body bytes that arrived through the read buffer
+    bool feed(const char *data, int length);
+
+    // Moves part content straight from the socket into the staged file (socket -> pipe -> file), at most
+    // maxLength bytes. Stops where the next bytes may be a delimiter, which feed() must see, or when the
+    // socket has nothing more. Returns the bytes moved, -1 when writing the file failed.
+    long spliceFrom(int socketFd, long maxLength);
+
+    bool isDone() const
+    {
+        return m_done;
+    }
+    // Writing to the staging directory failed, as opposed to a malformed body
+    bool ioFailed() const
+    {
+        return m_ioFailed;
+    }
+
+    // The response listing the staged files is going out: keep them
+    void commit();
+    // text/plain summary of the parts, returns the length or -1
+    int formatSummary(char *buffer, int size) const;
+
+    bool partBegin(const char *name, const char *filename) override;
+    bool partData(const char *data, int length) override;
+    bool partEnd() override;
+
+private:
+    struct StagedFile
+    {
+        char name[MultipartParser::MAX_NAME_LENGTH];
+        char filename[MultipartParser::MAX_NAME_LENGTH];
+        char path[256];
+        long size;
+    };
+
+    bool writeAll(const char *data, int length);
+
+private:
+    const char *m_directory;
+    int m_logStatus;
+    MultipartParser m_parser;
+    bool m_done;
+    bool m_ioFailed;
+    bool m_committed;
+
+    StagedFile m_files[MAX_FILES];
+    int m_fileCount;
+    int m_fieldCount;
+    int m_fileFd;           // The file part being written, -1 inside a plain field
+
+    int m_pipe[2];          // Created on the first splice
+    char *m_peekBuffer;     // From the buffer pool, only while splicing is in use
+    int m_peekCapacity;
+    bool m_spliceFailed;    // splice is unsupported here, stay on feed()
+};
+
+#endif
@@ -143,6 +143,9 @@ void Log::writeLog(int level, const char *format, ...)
                              myTm.tm_hour, myTm.tm_min, myTm.tm_sec, now.tv_usec, levelStr);
 
     int messageLen = vsnprintf(m_buffer + prefixLen, m_logBufSize - prefixLen - 1, format, args);
+    // vsnprintf returns the untruncated length; long messages are cut to fit the buffer
+    if (messageLen > m_logBufSize - prefixLen - 2)
+        messageLen = m_logBufSize - prefixLen - 2;
     m_buffer[prefixLen + messageLen] = '\n';
     m_buffer[prefixLen + messageLen + 1] = '\0';
     logMessage = m_buffer;
@@ -0,0 +1,82 @@
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+
+BufferPool::BufferPool()
+{
+    for (int i = 0; i < CLASS_COUNT; ++i)
+    {
+        m_free[i] = nullptr;
+        m_idleBytes[i] = 0;
+    }
+}
+
+BufferPool::~BufferPool()
+{
+    for (int i = 0; i < CLASS_COUNT; ++i)
+    {
+        while (m_free[i])
+        {
+            FreeBuffer *next = m_free[i]->next;
+            free(m_free[i]);
+            m_free[i] = next;
+        }
+    }
+}
+
+BufferPool *BufferPool::getInstance()
+{
+    static BufferPool instance;
+    return &instance;
+}
+
+int BufferPool::classOf(int size)
+{
+    int index = 0;
+    while (index < CLASS_COUNT && (1 << (MIN_SHIFT + index)) < size)
+        ++index;
+    return index;
+}
+
+char *BufferPool::acquire(int size, int &capacity)
+{
+    int index = classOf(size);
+    if (index >= CLASS_COUNT)
+        return nullptr;
+    capacity = 1 << (MIN_SHIFT + index);
+
+    m_lockers[index].lock();
+    FreeBuffer *buffer = m_free[index];
+    if (buffer)
+    {
+        m_free[index] = buffer->next;
+        m_idleBytes[index] -= capacity;
+    }
+    m_lockers[index].unlock();
+
+    if (!buffer)
+        buffer = static_cast<FreeBuffer *>(malloc(capacity));
+    return reinterpret_cast<char *>(buffer);
+}
+
+void BufferPool::release(char *buffer, int capacity)
+{
+    if (!buffer)
+        return;
+
+    int index = classOf(capacity);
+    m_lockers[index].lock();
+    if (m_idleBytes[index] + capacity <= MAX_IDLE_BYTES)
+    {
+        FreeBuffer *node = reinterpret_cast<FreeBuffer *>(buffer);
+        node->next = m_free[index];
+        m_free[index] = node;
+        m_idleBytes[index] += capacity;
+        buffer = nullptr;
+    }
+    m_lockers[index].unlock();
+
+    // Over the idle budget: give it back instead of caching
+    if (buffer)
+        free(buffer);
+}
@@ -0,0 +1,44 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include "../lock/locker.h"
+
+// 按2的幂分级的缓冲区池，所有线程共享
+// 连接只在请求处理期间借用读写缓冲区，空闲的长连接不占用缓冲区
+class BufferPool
+{
+public:
+    static const int MIN_SHIFT = 10;                    // Smallest class: 1 KB
+    static const int CLASS_COUNT = 11;                  // Largest class: 1 MB
+    static const size_t MAX_IDLE_BYTES = 4 << 20;       // Idle bytes kept per class, the rest goes back to malloc
+
+    // 单例模式
+    static BufferPool *getInstance();
+
+    // 借出至少size字节的缓冲区，capacity返回实际大小；超出最大级别时返回nullptr
+    char *acquire(int size, int &capacity);
+    void release(char *buffer, int capacity);
+
+    static int maxBufferSize()
+    {
+        return 1 << (MIN_SHIFT + CLASS_COUNT - 1);
+    }
+
+private:
+    BufferPool();
+    ~BufferPool();
+
+    static int classOf(int size);
+
+    struct FreeBuffer
+    {
+        FreeBuffer *next;
+    };
+
+    Locker m_lockers[CLASS_COUNT];
+    FreeBuffer *m_free[CLASS_COUNT];
+    size_t m_idleBytes[CLASS_COUNT];
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdlib.h>
+#include <exception>
+#include <new>
+#include <vector>
+
+// 定长对象的slab分配器：按块批量申请内存，释放的槽位挂入空闲链表复用
+// 不加锁，每个事件循环线程持有自己的实例，分配和释放都在该线程内完成
+template <typename T>
+class Slab
+{
+public:
+    explicit Slab(int objectsPerChunk = 64)
+        : m_objectsPerChunk(objectsPerChunk)
+        , m_free(nullptr)
+        , m_inUse(0)
+    {
+    }
+
+    ~Slab()
+    {
+        for (size_t i = 0; i < m_chunks.size(); ++i)
+            free(m_chunks[i]);
+    }
+
+    T *allocate()
+    {
+        if (!m_free)
+            grow();
+        Slot *slot = m_free;
+        m_free = slot->next;
+        ++m_inUse;
+        return new (slot->storage) T();
+    }
+
+    void release(T *object)
+    {
+        object->~T();
+        Slot *slot = reinterpret_cast<Slot *>(object);
+        slot->next = m_free;
+        m_free = slot;
+        --m_inUse;
+    }
+
+    int inUse() const
+    {
+        return m_inUse;
+    }
+
+private:
+    union Slot
+    {
+        Slot *next;
+        alignas(T) char storage[sizeof(T)];
+    };
+
+    void grow()
+    {
+        Slot *chunk = static_cast<Slot *>(malloc(sizeof(Slot) * m_objectsPerChunk));
+        if (!chunk)
+            throw std::exception();
+        m_chunks.push_back(chunk);
+        for (int i = 0; i < m_objectsPerChunk; ++i)
+        {
+            chunk[i].next = m_free;
+            m_free = &chunk[i];
+        }
+    }
+
+    Slab(const Slab &);
+    Slab &operator=(const Slab &);
+
+private:
+    int m_objectsPerChunk;
+    Slot *m_free;               // Free slots, threaded through the slots themselves
+    int m_inUse;
+    std::vector<Slot *> m_chunks;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "metrics.h"
+
+#include <stdio.h>
+
+static const char *const METRIC_NAMES[METRIC_COUNT] = {
+    "uploads_active",
+    "uploads_completed",
+    "uploads_failed",
+    "uploads_rejected",
+    "upload_files",
+    "upload_bytes",
+    "upload_spliced_bytes",
+    "pool_tasks_stolen",
+    "pool_tasks_affine",
+    "pool_tasks_migrated",
+    "lane_static_queued",
+    "lane_static_tasks",
+    "lane_static_wait_us",
+    "lane_static_rejected",
+    "lane_blocking_queued",
+    "lane_blocking_tasks",
+    "lane_blocking_wait_us",
+    "lane_blocking_rejected",
+};
+
+Metrics::Metrics()
+{
+    for (int i = 0; i < METRIC_COUNT; ++i)
+        m_values[i] = 0;
+}
+
+Metrics *Metrics::getInstance()
+{
+    static Metrics instance;
+    return &instance;
+}
+
+int Metrics::format(char *buffer, int size) const
+{
+    int length = 0;
+    for (int i = 0; i < METRIC_COUNT; ++i)
+    {
+        int written = snprintf(buffer + length, size - length, "%s %ld\n", METRIC_NAMES[i], get(MetricId(i)));
+        if (written >= size - length)
+            return -1;
+        length += written;
+    }
+    return length;
+}
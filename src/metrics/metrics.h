@@ -0,0 +1,54 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+
+// 进程级的计数器，所有线程共享，通过 GET /metrics 以文本形式输出
+enum MetricId
+{
+    METRIC_UPLOADS_ACTIVE = 0,      // Gauge: uploads whose body is still arriving
+    METRIC_UPLOADS_COMPLETED,
+    METRIC_UPLOADS_FAILED,          // Aborted: malformed body, disk error or the client went away
+    METRIC_UPLOADS_REJECTED,        // Over the size limit, or uploads are disabled
+    METRIC_UPLOAD_FILES,            // File parts staged
+    METRIC_UPLOAD_BYTES,            // File content written to the staging directory so far
+    METRIC_UPLOAD_SPLICED_BYTES,    // Part of the above moved socket -> pipe -> file without a copy
+    METRIC_POOL_TASKS_STOLEN,       // Taken from another worker's queue (work-stealing scheduling)
+    METRIC_POOL_TASKS_AFFINE,       // Ran on the worker that handled the connection's previous task
+    METRIC_POOL_TASKS_MIGRATED,     // Ran on a different worker than the connection's previous task
+    METRIC_LANE_STATIC_QUEUED,      // Gauge: requests waiting in the static lane
+    METRIC_LANE_STATIC_TASKS,       // Requests the static lane has taken up
+    METRIC_LANE_STATIC_WAIT_US,     // Their total time in the queue; divided by the above, the mean wait
+    METRIC_LANE_STATIC_REJECTED,    // Answered 503 because the static lane was full
+    METRIC_LANE_BLOCKING_QUEUED,    // Same for the lane of database-bound handlers
+    METRIC_LANE_BLOCKING_TASKS,
+    METRIC_LANE_BLOCKING_WAIT_US,
+    METRIC_LANE_BLOCKING_REJECTED,
+    METRIC_COUNT
+};
+
+class Metrics
+{
+public:
+    // 单例模式
+    static Metrics *getInstance();
+
+    void add(MetricId id, long value = 1)
+    {
+        m_values[id].fetch_add(value, std::memory_order_relaxed);
+    }
+    long get(MetricId id) const
+    {
+        return m_values[id].load(std::memory_order_relaxed);
+    }
+
+    // One "name value" line per metric; returns the length, or -1 when buffer is too small
+    int format(char *buffer, int size) const;
+
+private:
+    Metrics();
+
+    std::atomic<long> m_values[METRIC_COUNT];
+};
+
+#endif
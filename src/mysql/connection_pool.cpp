@@ -10,7 +10,7 @@
 
 
 ConnectionPool::ConnectionPool() 
-	: m_curConn(0), m_freeConn(0)
+	: m_maxConn(0), m_curConn(0), m_freeConn(0)
 {}
 
 ConnectionPool *ConnectionPool::getInstance() {
@@ -54,7 +54,8 @@ void ConnectionPool::init(const std::string &url, const std::string &user, const
 // 当有请求时，从数据库连接池中返回一个可用连接，更新使用和空闲连接数
 MYSQL *ConnectionPool::getConnection()
 {
-	if (m_connList.empty())
+	// No pool was set up; an empty list only means every connection is in use, wait for one
+	if (m_maxConn == 0)
         return nullptr;
 
 	m_reserve.wait();
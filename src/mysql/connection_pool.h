@@ -33,7 +33,7 @@ private:
     int m_curConn;       // 当前已使用的连接数
     int m_freeConn;      // 当前空闲的连接数
 	Locker m_lock;
-    list<MYSQL *> m_connList; // 连接池
+    std::list<MYSQL *> m_connList; // 连接池
     Semaphore m_reserve;
 
 public:
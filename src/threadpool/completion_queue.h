@@ -0,0 +1,77 @@
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <vector>
+#include <exception>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "../lock/locker.h"
+
+// 工作线程处理完一个事件后投递的结果
+struct Completion
+{
+    int sockFd;
+    unsigned int sequence;  // HttpConn::taskSequence of the task, tells a stale result from the current one
+    bool keepConnection;    // false: the worker failed to read/write, the loop should close the socket
+    bool idle;              // The response went out and the connection waits for the next request
+};
+
+// 工作线程向事件循环回报结果的通道：Reactor模式下的读写结果，以及每个任务的结束
+// 结果放入队列后写eventfd，事件循环在epoll中监听该eventfd并批量取出
+class CompletionQueue
+{
+public:
+    CompletionQueue()
+    {
+        m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_eventFd == -1)
+        {
+            throw std::exception();
+        }
+    }
+    ~CompletionQueue()
+    {
+        close(m_eventFd);
+    }
+
+    int getEventFd() const
+    {
+        return m_eventFd;
+    }
+
+    void post(int sockFd, unsigned int sequence, bool keepConnection, bool idle = false)
+    {
+        Completion completion;
+        completion.sockFd = sockFd;
+        completion.sequence = sequence;
+        completion.keepConnection = keepConnection;
+        completion.idle = idle;
+
+        m_mutex.lock();
+        m_completions.push_back(completion);
+        m_mutex.unlock();
+
+        uint64_t one = 1;
+        write(m_eventFd, &one, sizeof(one));
+    }
+
+    // Called by the event loop when the eventfd is readable
+    void drain(std::vector<Completion> &completions)
+    {
+        uint64_t count;
+        read(m_eventFd, &count, sizeof(count));
+
+        completions.clear();
+        m_mutex.lock();
+        completions.swap(m_completions);
+        m_mutex.unlock();
+    }
+
+private:
+    int m_eventFd;
+    Locker m_mutex;
+    std::vector<Completion> m_completions;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef EVENT_COUNT_H
+#define EVENT_COUNT_H
+
+#include <atomic>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// 基于futex的事件计数：让无锁结构上的线程在没有工作时休眠
+// 等待方：key = prepareWait()，再检查一次条件，条件成立则cancelWait()，否则wait(key)
+// 通知方：先让条件成立（如入队），再notify()；没有等待者时不进入内核
+class EventCount
+{
+public:
+    EventCount()
+        : m_epoch(0)
+        , m_waiters(0)
+    {
+    }
+
+    uint32_t prepareWait()
+    {
+        // The key is read before registering: a notify() from here on changes the epoch and futex will not sleep
+        uint32_t key = m_epoch.load(std::memory_order_relaxed);
+        m_waiters.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return key;
+    }
+
+    void cancelWait()
+    {
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void wait(uint32_t key)
+    {
+        futex(FUTEX_WAIT_PRIVATE, key);
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Wakes up to count waiters with one syscall; false when nobody was waiting
+    bool notify(int count = 1)
+    {
+        // Pairs with the fence in prepareWait(): either the waiter is seen here, or its re-check sees the condition
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int waiters = m_waiters.load(std::memory_order_relaxed);
+        if (waiters == 0)
+            return false;
+        m_epoch.fetch_add(1, std::memory_order_relaxed);
+        futex(FUTEX_WAKE_PRIVATE, count < waiters ? count : waiters);
+        return true;
+    }
+
+private:
+    long futex(int operation, uint32_t value)
+    {
+        return syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_epoch), operation, value, nullptr, nullptr, 0);
+    }
+
+    EventCount(const EventCount &);
+    EventCount &operator=(const EventCount &);
+
+private:
+    std::atomic<uint32_t> m_epoch;      // Futex word, bumped by notify() when someone waits
+    std::atomic<int> m_waiters;         // Threads between prepareWait() and the end of wait()/cancelWait()
+};
+
+#endif
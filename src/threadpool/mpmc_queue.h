@@ -0,0 +1,173 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "event_count.h"
+
+// 有界多生产者多消费者队列（Dmitry Vyukov的环形缓冲区算法）
+// 每个槽位带一个序号，生产者和消费者各自用CAS推进自己的位置，不加锁，入队出队不分配内存
+// 队列为空时消费者在futex上休眠；生产者只在有休眠者时才发起系统调用
+template <typename T>
+class MpmcQueue
+{
+public:
+    static const int CACHE_LINE_SIZE = 64;
+
+    // capacity is rounded up to a power of two
+    explicit MpmcQueue(size_t capacity)
+        : m_buffer(nullptr)
+        , m_mask(0)
+        , m_enqueuePosition(0)
+        , m_dequeuePosition(0)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        m_buffer = new Cell[size];
+        m_mask = size - 1;
+        for (size_t i = 0; i < size; ++i)
+            m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~MpmcQueue()
+    {
+        delete[] m_buffer;
+    }
+
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+    // Approximate while other threads push or pop
+    size_t size() const
+    {
+        size_t dequeued = m_dequeuePosition.load(std::memory_order_relaxed);
+        size_t enqueued = m_enqueuePosition.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    // false when the queue is full
+    bool push(const T &value)
+    {
+        if (!enqueue(value))
+            return false;
+        m_notEmpty.notify();
+        return true;
+    }
+
+    // Pushes values in order until the queue is full, then wakes as many consumers as values went in.
+    // Returns that number
+    int push(const T *values, int count)
+    {
+        int pushed = 0;
+        while (pushed < count && enqueue(values[pushed]))
+            ++pushed;
+        if (pushed > 0)
+            m_notEmpty.notify(pushed);
+        return pushed;
+    }
+
+    // false when the queue is empty
+    bool tryPop(T &value)
+    {
+        Cell *cell;
+        size_t position = m_dequeuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &m_buffer[position & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+            if (difference == 0)
+            {
+                if (m_dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = m_dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+        value = cell->value;
+        cell->sequence.store(position + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Blocks until a value is available
+    T pop()
+    {
+        T value;
+        while (!tryPop(value))
+        {
+            uint32_t key = m_notEmpty.prepareWait();
+            if (tryPop(value))
+            {
+                m_notEmpty.cancelWait();
+                break;
+            }
+            m_notEmpty.wait(key);
+        }
+        return value;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    bool enqueue(const T &value)
+    {
+        Cell *cell;
+        size_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &m_buffer[position & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+            if (difference == 0)
+            {
+                if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (difference < 0)
+            {
+                // The slot still holds the value from one lap ago
+                return false;
+            }
+            else
+            {
+                position = m_enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    MpmcQueue(const MpmcQueue &);
+    MpmcQueue &operator=(const MpmcQueue &);
+
+private:
+    // 生产者和消费者的位置各占一个缓存行，避免伪共享
+    char m_pad0[CACHE_LINE_SIZE];
+    Cell *m_buffer;
+    size_t m_mask;
+    char m_pad1[CACHE_LINE_SIZE - sizeof(Cell *) - sizeof(size_t)];
+    std::atomic<size_t> m_enqueuePosition;
+    char m_pad2[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_dequeuePosition;
+    char m_pad3[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+    EventCount m_notEmpty;              // Consumers of pop() park here
+    char m_pad4[CACHE_LINE_SIZE - sizeof(EventCount)];
+};
+
+#endif
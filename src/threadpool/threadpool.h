@@ -1,56 +1,138 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
-#include <list>
 #include <cstdio>
 #include <exception>
 #include <pthread.h>
-#include "../lock/locker.h"
+#include <time.h>
 #include "../mysql/connection_pool.h"
+#include "../metrics/metrics.h"
+#include "completion_queue.h"
+#include "event_count.h"
+#include "mpmc_queue.h"
+
+// 调度方式
+enum ScheduleMode
+{
+    SCHEDULE_SHARED = 0,    // One queue shared by every worker
+    SCHEDULE_STEALING       // A queue per worker, idle workers steal from a random victim
+};
+
+// 执行通道：静态/缓存响应与会阻塞在数据库上的请求分开排队，各有自己的线程和队列上限
+enum Lane
+{
+    LANE_STATIC = 0,
+    LANE_BLOCKING,
+    LANE_COUNT
+};
 
 template <typename T>
 class ThreadPool
 {
 public:
-    ThreadPool(int actorModel, ConnectionPool *connPool, int threadNumber = 8, int maxRequests = 10000);
+    ThreadPool(int actorModel, ConnectionPool *connPool, CompletionQueue *completionQueue, int scheduleMode,
+               int lane, int threadNumber = 8, int maxRequests = 10000);
     ~ThreadPool();
     bool append(T *request, int state);
     bool appendP(T *request);
+    // 一次提交一批请求（requestState已设置好），按请求数唤醒工作线程；返回入队的个数
+    // In stealing mode only the event loop thread may submit, the per-worker batch counts are not shared
+    int appendBatch(T *const *requests, int count);
+
+    // Reactor mode: requests this lane reads that need the database are handed to blocking after parsing
+    // of the request line. The blocking lane always uses the shared queue, so its workers may submit
+    void setBlockingLane(ThreadPool *blocking)
+    {
+        m_blockingLane = blocking;
+    }
 
 private:
+    struct Worker
+    {
+        ThreadPool *pool;
+        int index;
+        MpmcQueue<T *> *queue;      // Stealing mode only
+        EventCount wakeup;          // Stealing mode: parks the worker when no queue has work
+        unsigned int seed;          // Picks steal victims
+        char pad[MpmcQueue<T *>::CACHE_LINE_SIZE];  // Producers poll wakeup, keep it off the neighbour's line
+    };
+
     /*工作线程运行的函数，它不断从工作队列中取出任务并执行之*/
     static void *worker(void *arg);
-    void run();
+    void run(Worker &self);
+    T *take(Worker &self);
+    bool steal(Worker &self, T *&request);
+    void process(Worker &self, T *request);
+    bool handOff(T *request, unsigned int sequence);
+    static long nowMicroseconds();
 
 private:
     int m_threadNumber;          // 线程池中的线程数
     int m_maxRequests;           // 请求队列中允许的最大请求数
     pthread_t *m_threads;        // 描述线程池的数组，其大小为m_threadNumber
-    std::list<T *> m_workQueue;  // 请求队列
-    Locker m_queueLocker;        // 保护请求队列的互斥锁
-    Semaphore m_queueStat;       // 是否有任务需要处理
+    Worker *m_workers;
+    int m_scheduleMode;
+    MpmcQueue<T *> *m_workQueue; // 共享模式下的请求队列，无锁，空闲的工作线程在futex上等待
+    std::atomic<unsigned int> m_nextWorker;     // Round robin for connections no worker has served yet
+    std::atomic<int> m_parkedWorkers;           // Stealing mode: workers in or about to enter wait()
+    int *m_batchCounts;                         // Stealing mode: requests queued per worker by appendBatch()
+    int m_lane;
+    ThreadPool *m_blockingLane;                 // Static lane in reactor mode only
+    MetricId m_queuedMetric;                    // Per-lane queue depth, tasks run and time spent queued
+    MetricId m_tasksMetric;
+    MetricId m_waitMetric;
     ConnectionPool *m_connPool;  // 数据库连接池
     int m_actorModel;            // 事件处理模式
+    CompletionQueue *m_completionQueue;  // Reactor模式下回报处理结果
 };
 
 template <typename T>
-ThreadPool<T>::ThreadPool(int actorModel, ConnectionPool *connPool, int threadNumber, int maxRequests)
-    : m_actorModel(actorModel)
-    , m_threadNumber(threadNumber)
+ThreadPool<T>::ThreadPool(int actorModel, ConnectionPool *connPool, CompletionQueue *completionQueue, int scheduleMode,
+                          int lane, int threadNumber, int maxRequests)
+    : m_threadNumber(threadNumber)
     , m_maxRequests(maxRequests)
     , m_threads(nullptr)
+    , m_workers(nullptr)
+    , m_scheduleMode(scheduleMode)
+    , m_workQueue(nullptr)
+    , m_nextWorker(0)
+    , m_parkedWorkers(0)
+    , m_batchCounts(nullptr)
+    , m_lane(lane)
+    , m_blockingLane(nullptr)
+    , m_queuedMetric(lane == LANE_BLOCKING ? METRIC_LANE_BLOCKING_QUEUED : METRIC_LANE_STATIC_QUEUED)
+    , m_tasksMetric(lane == LANE_BLOCKING ? METRIC_LANE_BLOCKING_TASKS : METRIC_LANE_STATIC_TASKS)
+    , m_waitMetric(lane == LANE_BLOCKING ? METRIC_LANE_BLOCKING_WAIT_US : METRIC_LANE_STATIC_WAIT_US)
     , m_connPool(connPool)
+    , m_actorModel(actorModel)
+    , m_completionQueue(completionQueue)
 {
     if (threadNumber <= 0 || maxRequests <= 0)
         throw std::exception();
 
+    m_workers = new Worker[m_threadNumber];
+    for (int i = 0; i < m_threadNumber; ++i)
+    {
+        m_workers[i].pool = this;
+        m_workers[i].index = i;
+        m_workers[i].queue = nullptr;
+        m_workers[i].seed = 2654435761u * (i + 1);
+        // The request limit is split between the workers' queues
+        if (m_scheduleMode == SCHEDULE_STEALING)
+            m_workers[i].queue = new MpmcQueue<T *>((maxRequests + threadNumber - 1) / threadNumber);
+    }
+    if (m_scheduleMode == SCHEDULE_STEALING)
+        m_batchCounts = new int[m_threadNumber]();
+    else
+        m_workQueue = new MpmcQueue<T *>(maxRequests);
+
     m_threads = new pthread_t[m_threadNumber];
     if (!m_threads)
         throw std::exception();
 
     for (int i = 0; i < threadNumber; ++i)
     {
-        if (pthread_create(m_threads + i, nullptr, worker, this) != 0)
+        if (pthread_create(m_threads + i, nullptr, worker, m_workers + i) != 0)
         {
             delete[] m_threads;
             throw std::exception();
@@ -67,99 +149,247 @@ template <typename T>
 ThreadPool<T>::~ThreadPool()
 {
     delete[] m_threads;
+    for (int i = 0; i < m_threadNumber; ++i)
+        delete m_workers[i].queue;
+    delete[] m_workers;
+    delete m_workQueue;
+    delete[] m_batchCounts;
 }
 
 template <typename T>
 bool ThreadPool<T>::append(T *request, int state)
 {
-    m_queueLocker.lock();
-    if (m_workQueue.size() >= m_maxRequests)
-    {
-        m_queueLocker.unlock();
-        return false;
-    }
+    // The push publishes requestState to the worker that pops the request
     request->requestState = state;
-    m_workQueue.push_back(request);
-    m_queueLocker.unlock();
-    m_queueStat.post();
-    return true;
+    return appendBatch(&request, 1) == 1;
 }
 
 template <typename T>
 bool ThreadPool<T>::appendP(T *request)
 {
-    m_queueLocker.lock();
-    if (m_workQueue.size() >= m_maxRequests)
+    return appendBatch(&request, 1) == 1;
+}
+
+template <typename T>
+int ThreadPool<T>::appendBatch(T *const *requests, int count)
+{
+    // One clock read for the whole batch. The depth is raised before a worker can take the requests
+    long now = nowMicroseconds();
+    for (int i = 0; i < count; ++i)
+        requests[i]->queuedAt = now;
+    Metrics::getInstance()->add(m_queuedMetric, count);
+
+    if (m_scheduleMode != SCHEDULE_STEALING)
     {
-        m_queueLocker.unlock();
-        return false;
+        int pushed = m_workQueue->push(requests, count);
+        if (pushed < count)
+            Metrics::getInstance()->add(m_queuedMetric, pushed - count);
+        return pushed;
     }
-    m_workQueue.push_back(request);
-    m_queueLocker.unlock();
-    m_queueStat.post();
-    return true;
+
+    // 优先交给上次处理该连接的工作线程，它的缓存里还有这个连接的缓冲区
+    int queued = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        T *request = requests[i];
+        int target = request->lastWorker;
+        if (target < 0 || target >= m_threadNumber)
+            target = m_nextWorker.fetch_add(1, std::memory_order_relaxed) % m_threadNumber;
+        for (int j = 0; j < m_threadNumber; ++j)
+        {
+            int index = (target + j) % m_threadNumber;
+            if (m_workers[index].queue->push(request))
+            {
+                ++m_batchCounts[index];
+                ++queued;
+                break;
+            }
+        }
+    }
+
+    // One wake-up per parked owner, it drains its own queue. Each request queued behind a busy owner wakes a
+    // parked worker to steal it: the owner may be stuck in a long handler while the others sit idle
+    int stealable = 0;
+    for (int i = 0; i < m_threadNumber; ++i)
+    {
+        if (m_batchCounts[i] > 0 && !m_workers[i].wakeup.notify())
+            stealable += m_batchCounts[i];
+    }
+    for (int i = 0; stealable > 0 && i < m_threadNumber; ++i)
+    {
+        if (m_parkedWorkers.load(std::memory_order_relaxed) == 0)
+            break;
+        if (m_batchCounts[i] == 0 && m_workers[i].wakeup.notify())
+            --stealable;
+    }
+    for (int i = 0; i < m_threadNumber; ++i)
+        m_batchCounts[i] = 0;
+    if (queued < count)
+        Metrics::getInstance()->add(m_queuedMetric, queued - count);
+    return queued;
+}
+
+template <typename T>
+long ThreadPool<T>::nowMicroseconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000;
 }
 
 template <typename T>
 void *ThreadPool<T>::worker(void *arg)
 {
-    ThreadPool *pool = (ThreadPool *)arg;
-    pool->run();
-    return pool;
+    Worker *self = (Worker *)arg;
+    self->pool->run(*self);
+    return self->pool;
 }
+
 template <typename T>
-void ThreadPool<T>::run()
+void ThreadPool<T>::run(Worker &self)
 {
     while (true)
     {
-        m_queueStat.wait();
-        m_queueLocker.lock();
-        if (m_workQueue.empty())
-        {
-            m_queueLocker.unlock();
+        T *request = m_scheduleMode == SCHEDULE_STEALING ? take(self) : m_workQueue->pop();
+        if (!request)
             continue;
+        process(self, request);
+    }
+}
+
+// 先取自己队列中的请求，没有则去其他工作线程的队列里偷，都没有才休眠
+template <typename T>
+T *ThreadPool<T>::take(Worker &self)
+{
+    T *request;
+    while (true)
+    {
+        if (self.queue->tryPop(request))
+            return request;
+        if (steal(self, request))
+            return request;
+
+        m_parkedWorkers.fetch_add(1, std::memory_order_relaxed);
+        uint32_t key = self.wakeup.prepareWait();
+        if (self.queue->tryPop(request) || steal(self, request))
+        {
+            self.wakeup.cancelWait();
+            m_parkedWorkers.fetch_sub(1, std::memory_order_relaxed);
+            return request;
         }
+        self.wakeup.wait(key);
+        m_parkedWorkers.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
 
-        T *request = m_workQueue.front();
-        m_workQueue.pop_front();
-        m_queueLocker.unlock();
-        if (!request)
+template <typename T>
+bool ThreadPool<T>::steal(Worker &self, T *&request)
+{
+    if (m_threadNumber == 1)
+        return false;
+    // xorshift: a random first victim keeps thieves from piling onto the same queue
+    self.seed ^= self.seed << 13;
+    self.seed ^= self.seed >> 17;
+    self.seed ^= self.seed << 5;
+    int victim = self.seed % m_threadNumber;
+    for (int i = 0; i < m_threadNumber; ++i, victim = (victim + 1) % m_threadNumber)
+    {
+        if (victim == self.index)
             continue;
-        // Process the request
-        if (m_actorModel == 1)
+        if (m_workers[victim].queue->tryPop(request))
         {
-            if (request->requestState == 0)
+            Metrics::getInstance()->add(METRIC_POOL_TASKS_STOLEN);
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+void ThreadPool<T>::process(Worker &self, T *request)
+{
+    Metrics *metrics = Metrics::getInstance();
+    metrics->add(m_queuedMetric, -1);
+    metrics->add(m_tasksMetric);
+    metrics->add(m_waitMetric, nowMicroseconds() - request->queuedAt);
+
+    // Whether the connection's previous request ran on this worker too; the blocking lane has its own
+    // worker numbers and no locality to keep
+    if (m_lane == LANE_STATIC)
+    {
+        if (request->lastWorker == self.index)
+            metrics->add(METRIC_POOL_TASKS_AFFINE);
+        else if (request->lastWorker != -1)
+            metrics->add(METRIC_POOL_TASKS_MIGRATED);
+        request->lastWorker = self.index;
+    }
+
+    // Process the request
+    // In reactor mode the outcome is posted back to the event loop instead of flagged on the request
+    if (m_actorModel == 1)
+    {
+        int sockFd = request->getSocketFd();
+        // Read before the socket is re-armed: from then on the event loop may stage the next task
+        unsigned int sequence = request->taskSequence;
+        if (request->requestState == 0)
+        {
+            if (request->readFromSocket())
             {
-                if (request->readFromSocket())
-                {
-                  request->isImproved = 1;
-                  ConnectionRAII mysqlconn(&request->mysql, m_connPool);
-                  request->handleRequest(m_connPool);
-                }
-                else
-                {
-                  request->isImproved = 1
-                  request->timerFlag = 1;
-                }
+                // The blocking lane answers it and posts the completion
+                if (handOff(request, sequence))
+                    return;
+                request->handleRequest(m_connPool);
+                m_completionQueue->post(sockFd, sequence, true);
             }
             else
             {
-                if (request->writeToSocket())
-                {
-                  request->isImproved = 1
-                }
-                else
-                {
-                  request->isImproved = 1
-                  request->timerFlag = 1;
-                }
+                m_completionQueue->post(sockFd, sequence, false);
             }
         }
-        else
+        else if (request->requestState == 2)
         {
-            ConnectionRAII mysqlconn(&request->mysql, m_connPool);
             request->handleRequest(m_connPool);
+            m_completionQueue->post(sockFd, sequence, true);
+        }
+        else
+        {
+            bool requestBuffered;
+            bool idle;
+            bool keepConnection = request->writeToSocket(requestBuffered, idle);
+            // A pipelined request is answered right away, it will not raise another read event.
+            // A register among them goes to the blocking lane like a freshly read one, which posts the completion
+            if (requestBuffered)
+            {
+                if (handOff(request, sequence))
+                    return;
+                request->handleRequest(m_connPool);
+            }
+            m_completionQueue->post(sockFd, sequence, keepConnection, idle);
         }
     }
+    else
+    {
+        int sockFd = request->getSocketFd();
+        unsigned int sequence = request->taskSequence;
+        // Only the register handler takes a database connection, and only for its INSERT
+        request->handleRequest(m_connPool);
+        // The event loop may free the connection only after this
+        m_completionQueue->post(sockFd, sequence, true);
+    }
+}
+
+// 读到的请求需要数据库时转交阻塞通道；该通道满了则直接回复503，不占用本通道的线程
+template <typename T>
+bool ThreadPool<T>::handOff(T *request, unsigned int sequence)
+{
+    if (!m_blockingLane || !request->needsBlockingLane())
+        return false;
+    request->requestState = 2;
+    if (m_blockingLane->appendBatch(&request, 1) == 1)
+        return true;
+    Metrics::getInstance()->add(METRIC_LANE_BLOCKING_REJECTED);
+    request->rejectRequest();
+    m_completionQueue->post(request->getSocketFd(), sequence, true);
+    return true;
 }
 #endif
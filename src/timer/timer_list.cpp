@@ -1,153 +1,235 @@
 #include "timer_list.h"
-#include "../http/http_conn.h"
 
-SortTimerList::SortTimerList()
+static void initSlot(UtilTimer *slot)
 {
-    head = NULL;
-    tail = NULL;
+    slot->prev = slot;
+    slot->next = slot;
 }
-SortTimerList::~SortTimerList()
+
+TimerWheel::TimerWheel()
+    : m_current(getCurrentMs())
+    , m_nextExpire(INT64_MAX)
+    , m_count(0)
 {
-    UtilTimer *tmp = head;
-    while (tmp)
-    {
-        head = tmp->next;
-        delete tmp;
-        tmp = head;
-    }
+    for (int i = 0; i < NEAR_SIZE; ++i)
+        initSlot(&m_near[i]);
+    for (int level = 0; level < LEVEL_COUNT; ++level)
+        for (int i = 0; i < LEVEL_SIZE; ++i)
+            initSlot(&m_levels[level][i]);
 }
 
-void SortTimerList::addTimer(UtilTimer *timer)
+// 按距离到期的时间选择层级和槽位
+void TimerWheel::place(UtilTimer *timer)
 {
-    if (!timer)
+    int64_t expire = timer->expire;
+    int64_t delta = expire - m_current;
+    UtilTimer *slot;
+
+    if (delta < 0)
     {
-        return;
+        // Already due: fire on the next processed millisecond
+        slot = &m_near[m_current & (NEAR_SIZE - 1)];
     }
-    if (!head)
+    else if (delta < NEAR_SIZE)
     {
-        head = tail = timer;
-        return;
+        slot = &m_near[expire & (NEAR_SIZE - 1)];
     }
-    if (timer->expire < head->expire)
+    else
     {
-        timer->next = head;
-        head->prev = timer;
-        head = timer;
-        return;
+        int level = 0;
+        int shift = NEAR_BITS + LEVEL_BITS;
+        while (level < LEVEL_COUNT - 1 && delta >= ((int64_t)1 << shift))
+        {
+            ++level;
+            shift += LEVEL_BITS;
+        }
+        // Deadlines beyond the last level are parked in its furthest slot and re-placed on cascade
+        if (delta >= ((int64_t)1 << shift))
+            expire = m_current + ((int64_t)1 << shift) - 1;
+        slot = &m_levels[level][(expire >> (shift - LEVEL_BITS)) & (LEVEL_SIZE - 1)];
     }
-    addTimer(timer, head);
+
+    timer->prev = slot->prev;
+    timer->next = slot;
+    slot->prev->next = timer;
+    slot->prev = timer;
 }
-void SortTimerList::adjustTimer(UtilTimer *timer)
+
+void TimerWheel::unlink(UtilTimer *timer)
 {
-    if (!timer)
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+}
+
+// 将上层槽位中的定时器重新放入更低的层级
+void TimerWheel::cascade(int level, int index)
+{
+    UtilTimer *slot = &m_levels[level][index];
+    UtilTimer *timer = slot->next;
+    initSlot(slot);
+    while (timer != slot)
     {
-        return;
+        UtilTimer *next = timer->next;
+        place(timer);
+        timer = next;
     }
-    UtilTimer *tmp = timer->next;
-    if (!tmp || (timer->expire < tmp->expire))
+}
+
+void TimerWheel::addTimer(UtilTimer *timer)
+{
+    if (!timer)
     {
         return;
     }
-    if (timer == head)
-    {
-        head = head->next;
-        head->prev = NULL;
-        timer->next = NULL;
-        addTimer(timer, head);
-    }
-    else
-    {
-        timer->prev->next = timer->next;
-        timer->next->prev = timer->prev;
-        addTimer(timer, timer->next);
-    }
+    place(timer);
+    ++m_count;
+    if (timer->expire < m_nextExpire)
+        m_nextExpire = timer->expire;
 }
-void SortTimerList::deleteTimer(UtilTimer *timer)
+
+void TimerWheel::adjustTimer(UtilTimer *timer)
 {
-    if (!timer)
+    if (!timer || !timer->next)
     {
         return;
     }
-    if ((timer == head) && (timer == tail))
-    {
-        delete timer;
-        head = NULL;
-        tail = NULL;
+    unlink(timer);
+    place(timer);
+    if (timer->expire < m_nextExpire)
+        m_nextExpire = timer->expire;
+}
+
+// 延长只改timeout，到期时惰性顺延；缩短则按新的到期时间重新放置
+void TimerWheel::setTimeout(UtilTimer *timer, int64_t timeout)
+{
+    if (timer->timeout == timeout)
         return;
+    timer->timeout = timeout;
+    int64_t deadline = timer->userData->lastActive + timeout;
+    if (deadline < timer->expire)
+    {
+        timer->expire = deadline;
+        adjustTimer(timer);
     }
-    if (timer == head)
+}
+
+void TimerWheel::deleteTimer(UtilTimer *timer)
+{
+    if (!timer)
     {
-        head = head->next;
-        head->prev = NULL;
-        delete timer;
         return;
     }
-    if (timer == tail)
+    if (timer->next)
     {
-        tail = tail->prev;
-        tail->next = NULL;
-        delete timer;
-        return;
+        unlink(timer);
+        --m_count;
     }
-    timer->prev->next = timer->next;
-    timer->next->prev = timer->prev;
-    delete timer;
 }
-void SortTimerList::tick()
+
+void TimerWheel::tick(std::vector<int> &expired)
 {
-    if (!head)
+    int64_t now = getCurrentMs();
+    if (m_count == 0)
     {
+        m_current = now + 1;
         return;
     }
-    
-    time_t cur = time(NULL);
-    UtilTimer *tmp = head;
-    while (tmp)
+
+    while (m_current <= now)
     {
-        if (cur < tmp->expire)
+        int index = m_current & (NEAR_SIZE - 1);
+        if (index == 0)
         {
-            break;
+            // The near wheel wrapped: pull down the next slot of each level that wrapped too
+            for (int level = 0; level < LEVEL_COUNT; ++level)
+            {
+                int levelIndex = (m_current >> (NEAR_BITS + level * LEVEL_BITS)) & (LEVEL_SIZE - 1);
+                cascade(level, levelIndex);
+                if (levelIndex != 0)
+                    break;
+            }
         }
-        tmp->callback(tmp->userData);
-        head = tmp->next;
-        if (head)
+
+        UtilTimer *slot = &m_near[index];
+        while (slot->next != slot)
         {
-            head->prev = NULL;
+            UtilTimer *timer = slot->next;
+            unlink(timer);
+
+            // 到期前有过活动：按最后活动时间顺延，重新放入时间轮
+            if (timer->timeout > 0)
+            {
+                int64_t deadline = timer->userData->lastActive + timer->timeout;
+                if (deadline > m_current)
+                {
+                    timer->expire = deadline;
+                    place(timer);
+                    continue;
+                }
+            }
+
+            --m_count;
+            expired.push_back(timer->userData->sockFd);
         }
-        delete tmp;
-        tmp = head;
+        ++m_current;
     }
+    m_nextExpire = computeNextExpire();
 }
 
-void SortTimerList::addTimer(UtilTimer *timer, UtilTimer *lst_head)
+int64_t TimerWheel::getNextExpire() const
 {
-    UtilTimer *prev = lst_head;
-    UtilTimer *tmp = prev->next;
-    while (tmp)
+    return m_count == 0 ? -1 : m_nextExpire;
+}
+
+// 近层槽位按精确的到期时间存放；上层槽位中的定时器最早在该槽位下放时到期
+int64_t TimerWheel::computeNextExpire() const
+{
+    if (m_count == 0)
+        return INT64_MAX;
+
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < NEAR_SIZE; ++i)
     {
-        if (timer->expire < tmp->expire)
+        const UtilTimer *slot = &m_near[(m_current + i) & (NEAR_SIZE - 1)];
+        if (slot->next != slot)
         {
-            prev->next = timer;
-            timer->next = tmp;
-            tmp->prev = timer;
-            timer->prev = prev;
+            next = m_current + i;
             break;
         }
-        prev = tmp;
-        tmp = tmp->next;
     }
-    if (!tmp)
+
+    int shift = NEAR_BITS;
+    for (int level = 0; level < LEVEL_COUNT; ++level, shift += LEVEL_BITS)
     {
-        prev->next = timer;
-        timer->prev = prev;
-        timer->next = NULL;
-        tail = timer;
+        int64_t span = (int64_t)1 << shift;
+        int64_t boundary = (m_current + span - 1) & ~(span - 1);
+        for (int i = 0; i < LEVEL_SIZE && boundary + i * span < next; ++i)
+        {
+            int64_t time = boundary + i * span;
+            const UtilTimer *slot = &m_levels[level][(time >> shift) & (LEVEL_SIZE - 1)];
+            if (slot->next != slot)
+            {
+                next = time;
+                break;
+            }
+        }
     }
+    return next;
+}
+
+Utils::~Utils()
+{
+    if (m_timerFd != -1)
+        close(m_timerFd);
 }
 
 void Utils::init(int timeslot)
 {
     m_TIMESLOT = timeslot;
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    assert(m_timerFd != -1);
 }
 
 //对文件描述符设置非阻塞
@@ -176,16 +258,6 @@ void Utils::addFd(int epollfd, int fd, bool one_shot, int TRIGMode)
     setNonBlocking(fd);
 }
 
-//信号处理函数
-void Utils::signalHandler(int sig)
-{
-    //为保证函数的可重入性，保留原来的errno
-    int save_errno = errno;
-    int msg = sig;
-    send(u_pipeFds[1], (char *)&msg, 1, 0);
-    errno = save_errno;
-}
-
 //设置信号函数
 void Utils::addSignal(int sig, void(handler)(int), bool restart)
 {
@@ -198,11 +270,33 @@ void Utils::addSignal(int sig, void(handler)(int), bool restart)
     assert(sigaction(sig, &sa, NULL) != -1);
 }
 
-//定时处理任务，重新定时以不断触发SIGALRM信号
-void Utils::timerHandler()
+//定时处理任务，并按时间轮中最早的到期时间重新设定timerfd
+void Utils::timerHandler(std::vector<int> &expired)
+{
+    uint64_t expirations;
+    read(m_timerFd, &expirations, sizeof(expirations));
+
+    expired.clear();
+    m_timerList.tick(expired);
+    m_armedExpire = -1;
+    updateTimerFd();
+}
+
+void Utils::updateTimerFd()
 {
-    m_timerList.tick();
-    alarm(m_TIMESLOT);
+    int64_t next = m_timerList.getNextExpire();
+    if (next == -1 || (m_armedExpire != -1 && m_armedExpire <= next))
+        return;
+
+    // Absolute monotonic deadline; one already in the past fires immediately
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = next / 1000;
+    spec.it_value.tv_nsec = (next % 1000) * 1000000;
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+        spec.it_value.tv_nsec = 1;
+    timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+    m_armedExpire = next;
 }
 
 void Utils::showError(int connfd, const char *info)
@@ -210,15 +304,3 @@ void Utils::showError(int connfd, const char *info)
     send(connfd, info, strlen(info), 0);
     close(connfd);
 }
-
-int *Utils::u_pipeFds = 0;
-int Utils::u_epollFd = 0;
-
-class Utils;
-void callback(ClientData *user_data)
-{
-    epoll_ctl(Utils::u_epollFd, EPOLL_CTL_DEL, user_data->sockFd, 0);
-    assert(user_data);
-    close(user_data->sockFd);
-    HttpConn::g_userCount -- ;
-}
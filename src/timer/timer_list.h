@@ -20,57 +20,98 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/timerfd.h>
 
 #include <time.h>
+#include <stdint.h>
+#include <vector>
 #include "../log/log.h"
 
-class UtilTimer;
-
-struct ClientData
+// 单调时钟的毫秒数，定时器的到期时间以此为基准
+inline int64_t getCurrentMs()
 {
-    sockaddr_in address;
-    int sockFd;
-    UtilTimer *timer;
-};
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+struct ClientData;
 
 class UtilTimer
 {
 public:
-    UtilTimer() : prev(NULL), next(NULL) {}
+    UtilTimer() : expire(0), timeout(0), userData(NULL), prev(NULL), next(NULL) {}
+
+    // 是否仍挂在时间轮上（连接未关闭）
+    bool isActive() const { return next != NULL; }
 
 public:
-    time_t expire;
-    
-    void (* callback)(ClientData *);
+    int64_t expire;     // Absolute deadline in getCurrentMs() milliseconds
+    // Idle timeout; when non-zero, a due timer is re-queued to userData->lastActive + timeout if that is later
+    int64_t timeout;
+
     ClientData *userData;
     UtilTimer *prev;
     UtilTimer *next;
 };
 
-class SortTimerList
+// 定时器节点内嵌在连接数据中，不再单独分配
+// 读写时只记录lastActive，由时间轮在到期时检查并惰性顺延
+struct ClientData
+{
+    sockaddr_in address;
+    int sockFd;
+    int64_t lastActive; // Loop time of the last read or write
+    UtilTimer timer;
+};
+
+// 分层时间轮：第一层256个1ms的槽，其后四层各64个槽，每层的粒度是上一层的整圈
+// 添加、调整、删除均为O(1)；tick时逐毫秒推进，到达上层槽位时将其中的定时器下放
+class TimerWheel
 {
 public:
-    SortTimerList();
-    ~SortTimerList();
+    // No destructor: the nodes are embedded in connection slots owned by the event loop's slab
+    TimerWheel();
 
     void addTimer(UtilTimer *timer);
     void adjustTimer(UtilTimer *timer);
+    // Switches the idle timeout, counted from userData->lastActive; a shorter one takes effect at once
+    void setTimeout(UtilTimer *timer, int64_t timeout);
+    // Only unlinks: timer nodes are owned by their ClientData
     void deleteTimer(UtilTimer *timer);
-    void tick();
+    // Unlinks the timers that are due and appends their sockets to expired; the owning loop closes them
+    void tick(std::vector<int> &expired);
 
-private:
-    void addTimer(UtilTimer *timer, UtilTimer *lst_head);
+    // Earliest moment a timer can fire (a lower bound, never later than the real deadline), -1 if empty
+    int64_t getNextExpire() const;
 
-    UtilTimer *head;
-    UtilTimer *tail;
+private:
+    static const int NEAR_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int NEAR_SIZE = 1 << NEAR_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int LEVEL_COUNT = 4;
+
+    void place(UtilTimer *timer);
+    void unlink(UtilTimer *timer);
+    void cascade(int level, int index);
+    int64_t computeNextExpire() const;
+
+    // Each slot is a circular list headed by a sentinel node
+    UtilTimer m_near[NEAR_SIZE];
+    UtilTimer m_levels[LEVEL_COUNT][LEVEL_SIZE];
+    int64_t m_current;  // Next millisecond to be processed
+    int64_t m_nextExpire;
+    int m_count;
 };
 
 class Utils
 {
 public:
-    Utils() {}
-    ~Utils() {}
+    Utils() : m_timerFd(-1), m_armedExpire(-1), m_now(getCurrentMs()) {}
+    ~Utils();
 
+    // 创建驱动时间轮的timerfd
     void init(int timeslot);
 
     //对文件描述符设置非阻塞
@@ -79,24 +120,26 @@ public:
     //将内核事件表注册读事件，ET模式，选择开启EPOLLONESHOT
     void addFd(int epollfd, int fd, bool one_shot, int TRIGMode);
 
-    //信号处理函数
-    static void signalHandler(int sig);
-
     //设置信号函数
     void addSignal(int sig, void(handler)(int), bool restart = true);
 
-    //定时处理任务，重新定时以不断触发SIGALRM信号
-    void timerHandler();
+    // timerfd可读时调用：取出到期连接的fd交给调用者关闭，并重新设定timerfd
+    void timerHandler(std::vector<int> &expired);
+
+    // 时间轮中出现更早的到期时间时，提前timerfd的触发时刻
+    void updateTimerFd();
+
+    // 每轮事件循环读取一次时钟，连接活动只记录这个缓存值
+    void updateNow() { m_now = getCurrentMs(); }
 
     void showError(int connfd, const char *info);
 
 public:
-    static int *u_pipeFds;
-    SortTimerList m_timerList;
-    static int u_epollFd;
+    TimerWheel m_timerList;
     int m_TIMESLOT;
+    int m_timerFd;
+    int64_t m_armedExpire;  // Deadline the timerfd is currently armed for, -1 if disarmed
+    int64_t m_now;          // Cached loop time, see updateNow()
 };
 
-void callback(ClientData *user_data);
-
 #endif
@@ -0,0 +1,180 @@
+#include "io_uring.h"
+
+IoUring::IoUring()
+    : m_ringFd(-1)
+    , m_sqRing(MAP_FAILED)
+    , m_sqRingSize(0)
+    , m_cqRing(MAP_FAILED)
+    , m_cqRingSize(0)
+    , m_sqes(nullptr)
+    , m_sqesSize(0)
+    , m_sqeTail(0)
+    , m_sqeSubmitted(0)
+    , m_bufferRing(nullptr)
+    , m_bufferRingSize(0)
+    , m_buffers(nullptr)
+    , m_bufferEntries(0)
+    , m_bufferSize(0)
+    , m_bufferTail(0)
+{
+}
+
+IoUring::~IoUring()
+{
+    if (m_buffers)
+        munmap(m_buffers, (size_t)m_bufferEntries * m_bufferSize);
+    if (m_bufferRing)
+        munmap(m_bufferRing, m_bufferRingSize);
+    if (m_sqes)
+        munmap(m_sqes, m_sqesSize);
+    if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+        munmap(m_cqRing, m_cqRingSize);
+    if (m_sqRing != MAP_FAILED)
+        munmap(m_sqRing, m_sqRingSize);
+    if (m_ringFd != -1)
+        close(m_ringFd);
+}
+
+bool IoUring::init(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    m_ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    if (m_ringFd < 0)
+        return false;
+
+    // Require a single mmap for both rings (5.4+) and stable submissions (5.5+)
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP))
+        return false;
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (m_cqRingSize > m_sqRingSize)
+        m_sqRingSize = m_cqRingSize;
+
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED)
+        return false;
+    m_cqRing = m_sqRing;
+    m_cqRingSize = m_sqRingSize;
+
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+        return false;
+    m_sqes = (io_uring_sqe *)sqes;
+
+    char *sq = (char *)m_sqRing;
+    m_sqHead = (unsigned *)(sq + params.sq_off.head);
+    m_sqTail = (unsigned *)(sq + params.sq_off.tail);
+    m_sqMask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    m_sqEntries = *(unsigned *)(sq + params.sq_off.ring_entries);
+    m_sqeTail = m_sqeSubmitted = *m_sqTail;
+
+    // SQ slots map one-to-one onto the SQE array
+    unsigned *array = (unsigned *)(sq + params.sq_off.array);
+    for (unsigned i = 0; i < m_sqEntries; ++i)
+        array[i] = i;
+
+    char *cq = (char *)m_cqRing;
+    m_cqHead = (unsigned *)(cq + params.cq_off.head);
+    m_cqTail = (unsigned *)(cq + params.cq_off.tail);
+    m_cqMask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+    return true;
+}
+
+int IoUring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, m_ringFd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+io_uring_sqe *IoUring::getSqe()
+{
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if (m_sqeTail - head >= m_sqEntries)
+    {
+        submit();
+        head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if (m_sqeTail - head >= m_sqEntries)
+            return nullptr;
+    }
+
+    io_uring_sqe *sqe = &m_sqes[m_sqeTail & m_sqMask];
+    ++m_sqeTail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int IoUring::submit()
+{
+    return submitAndWait(0);
+}
+
+int IoUring::submitAndWait(unsigned waitCount)
+{
+    unsigned toSubmit = m_sqeTail - m_sqeSubmitted;
+    __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+    m_sqeSubmitted = m_sqeTail;
+
+    if (toSubmit == 0 && waitCount == 0)
+        return 0;
+
+    int ret = enter(toSubmit, waitCount, waitCount > 0 ? IORING_ENTER_GETEVENTS : 0);
+    return ret < 0 ? -errno : ret;
+}
+
+io_uring_cqe *IoUring::peekCqe()
+{
+    unsigned head = *m_cqHead;
+    if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+        return nullptr;
+    return &m_cqes[head & m_cqMask];
+}
+
+void IoUring::cqeSeen()
+{
+    __atomic_store_n(m_cqHead, *m_cqHead + 1, __ATOMIC_RELEASE);
+}
+
+bool IoUring::setupBufferRing(unsigned short groupId, unsigned entries, unsigned bufferSize)
+{
+    // entries must be a power of two
+    m_bufferRingSize = entries * sizeof(io_uring_buf);
+    void *ring = mmap(nullptr, m_bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+        return false;
+    m_bufferRing = (io_uring_buf_ring *)ring;
+
+    void *buffers = mmap(nullptr, (size_t)entries * bufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED)
+        return false;
+    m_buffers = (char *)buffers;
+    m_bufferEntries = entries;
+    m_bufferSize = bufferSize;
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)m_bufferRing;
+    reg.ring_entries = entries;
+    reg.bgid = groupId;
+    if (syscall(__NR_io_uring_register, m_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return false;
+
+    for (unsigned i = 0; i < entries; ++i)
+        recycleBuffer(i);
+    return true;
+}
+
+// Hand a buffer back to the kernel once its contents have been consumed
+void IoUring::recycleBuffer(unsigned short bufferId)
+{
+    // Index the ring by hand: in C++ the header's flexible-array wrapper shifts bufs[] by 8 bytes
+    io_uring_buf *buffer = (io_uring_buf *)m_bufferRing + (m_bufferTail & (m_bufferEntries - 1));
+    buffer->addr = (uint64_t)(uintptr_t)getBuffer(bufferId);
+    buffer->len = m_bufferSize;
+    buffer->bid = bufferId;
+    ++m_bufferTail;
+    __atomic_store_n(&m_bufferRing->tail, m_bufferTail, __ATOMIC_RELEASE);
+}
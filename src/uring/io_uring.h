@@ -0,0 +1,73 @@
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+// 基于io_uring系统调用的最小封装（不依赖liburing）
+// 提供SQ/CQ环的映射、提交与收割，以及用于recv的provided buffer ring
+class IoUring
+{
+public:
+    IoUring();
+    ~IoUring();
+
+    // Returns false when the kernel does not support io_uring (or the needed features)
+    bool init(unsigned entries);
+
+    // Next free submission entry, zeroed; flushes pending entries when the SQ is full
+    io_uring_sqe *getSqe();
+    int submit();
+    int submitAndWait(unsigned waitCount);
+
+    // Completion queue iteration: peek, handle, then mark as seen
+    io_uring_cqe *peekCqe();
+    void cqeSeen();
+
+    // Provided buffers for IOSQE_BUFFER_SELECT receives
+    bool setupBufferRing(unsigned short groupId, unsigned entries, unsigned bufferSize);
+    char *getBuffer(unsigned short bufferId)
+    {
+        return m_buffers + (size_t)bufferId * m_bufferSize;
+    }
+    void recycleBuffer(unsigned short bufferId);
+
+private:
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+
+private:
+    int m_ringFd;
+
+    void *m_sqRing;
+    size_t m_sqRingSize;
+    void *m_cqRing;
+    size_t m_cqRingSize;
+    io_uring_sqe *m_sqes;
+    size_t m_sqesSize;
+
+    unsigned *m_sqHead;
+    unsigned *m_sqTail;
+    unsigned m_sqMask;
+    unsigned m_sqEntries;
+    unsigned m_sqeTail;         // Local tail, published to m_sqTail on submit
+    unsigned m_sqeSubmitted;
+
+    unsigned *m_cqHead;
+    unsigned *m_cqTail;
+    unsigned m_cqMask;
+    io_uring_cqe *m_cqes;
+
+    io_uring_buf_ring *m_bufferRing;
+    size_t m_bufferRingSize;
+    char *m_buffers;
+    unsigned m_bufferEntries;
+    unsigned m_bufferSize;
+    unsigned short m_bufferTail;
+};
+
+#endif
@@ -0,0 +1,234 @@
+#include "sub_reactor.h"
+
+SubReactor::SubReactor()
+    : m_id(0)
+    , m_started(false)
+    , m_stop(false)
+    , m_epollFd(-1)
+    , m_wakeupFd(-1)
+    , m_users(nullptr)
+    , m_connPool(nullptr)
+{
+}
+
+SubReactor::~SubReactor()
+{
+    stop();
+    delete[] m_users;
+    if (m_wakeupFd != -1)
+        close(m_wakeupFd);
+    if (m_epollFd != -1)
+        close(m_epollFd);
+}
+
+void SubReactor::init(int id, int maxFileDescriptors, char* rootDirectory, int connectionTriggerMode, int logStatus,
+                      int timeSlot, int maxRequestSize, int sendFile, int cacheMaxAge,
+                      const char* uploadDirectory, long maxUploadSize, int keepAliveTimeout, int maxKeepAliveRequests,
+                      ConnectionPool* connPool)
+{
+    m_id = id;
+    // Each sub-reactor indexes only its own connections, no other thread writes to the table
+    m_users = new HttpConn*[maxFileDescriptors]();
+    m_rootDirectory = rootDirectory;
+    m_connectionTriggerMode = connectionTriggerMode;
+    m_logStatus = logStatus;
+    m_timeSlot = timeSlot;
+    m_maxRequestSize = maxRequestSize;
+    m_sendFile = sendFile;
+    m_cacheMaxAge = cacheMaxAge;
+    m_uploadDirectory = uploadDirectory;
+    m_maxUploadSize = maxUploadSize;
+    m_keepAliveTimeout = keepAliveTimeout;
+    m_maxKeepAliveRequests = maxKeepAliveRequests;
+    m_connPool = connPool;
+
+    m_epollFd = epoll_create(5);
+    assert(m_epollFd != -1);
+
+    m_wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(m_wakeupFd != -1);
+
+    m_utils.init(timeSlot);
+    m_utils.addFd(m_epollFd, m_wakeupFd, false, 0);
+    m_utils.addFd(m_epollFd, m_utils.m_timerFd, false, 0);
+}
+
+void SubReactor::start()
+{
+    if (pthread_create(&m_thread, nullptr, worker, this) != 0)
+        throw std::exception();
+    m_started = true;
+}
+
+void SubReactor::stop()
+{
+    if (!m_started)
+        return;
+    m_stop = true;
+    uint64_t one = 1;
+    write(m_wakeupFd, &one, sizeof(one));
+    pthread_join(m_thread, nullptr);
+    m_started = false;
+}
+
+bool SubReactor::dispatch(int connectionFd, const sockaddr_in& clientAddress)
+{
+    m_pendingLocker.lock();
+    m_pending.push_back(std::make_pair(connectionFd, clientAddress));
+    m_pendingLocker.unlock();
+
+    uint64_t one = 1;
+    return write(m_wakeupFd, &one, sizeof(one)) == sizeof(one);
+}
+
+void* SubReactor::worker(void* arg)
+{
+    // SIGTERM/SIGHUP stay blocked (inherited mask) and are read by the main reactor's signalfd
+    SubReactor* reactor = (SubReactor*)arg;
+    reactor->run();
+    return reactor;
+}
+
+void SubReactor::acceptPending()
+{
+    uint64_t count;
+    read(m_wakeupFd, &count, sizeof(count));
+
+    std::vector<std::pair<int, sockaddr_in> > pending;
+    m_pendingLocker.lock();
+    pending.swap(m_pending);
+    m_pendingLocker.unlock();
+
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+        addTimer(pending[i].first, pending[i].second);
+    }
+}
+
+void SubReactor::addTimer(int connectionFd, const sockaddr_in& clientAddress)
+{
+    HttpConn* conn = m_connectionSlab.allocate();
+    m_users[connectionFd] = conn;
+    conn->init(m_epollFd, connectionFd, clientAddress, m_rootDirectory, m_connectionTriggerMode, m_logStatus,
+               m_maxRequestSize, m_sendFile, m_cacheMaxAge, m_uploadDirectory, m_maxUploadSize,
+               m_keepAliveTimeout, m_maxKeepAliveRequests);
+
+    conn->clientData.address = clientAddress;
+    conn->clientData.sockFd = connectionFd;
+    conn->clientData.lastActive = m_utils.m_now;
+    UtilTimer* timer = &conn->clientData.timer;
+    timer->userData = &conn->clientData;
+    timer->timeout = 3 * m_timeSlot * 1000;
+    timer->expire = m_utils.m_now + timer->timeout;
+    m_utils.m_timerList.addTimer(timer);
+}
+
+void SubReactor::adjustTimer(UtilTimer* timer)
+{
+    timer->userData->lastActive = m_utils.m_now;
+}
+
+void SubReactor::setIdle(UtilTimer* timer, bool idle)
+{
+    m_utils.m_timerList.setTimeout(timer, idle ? m_keepAliveTimeout * 1000 : 3 * m_timeSlot * 1000);
+}
+
+void SubReactor::closeConnection(int socketFd)
+{
+    HttpConn* conn = m_users[socketFd];
+    if (!conn)
+        return;
+
+    m_utils.m_timerList.deleteTimer(&conn->clientData.timer);
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, socketFd, 0);
+    // The fd number may be handed out again as soon as it is closed, so the slot is cleared first
+    m_users[socketFd] = nullptr;
+    m_connectionSlab.release(conn);
+    close(socketFd);
+    -- HttpConn::g_userCount;
+
+    LOG_INFO(m_logStatus, "Sub-reactor %d closed socket %d", m_id, socketFd);
+}
+
+void SubReactor::handleRead(int socketFd)
+{
+    // Closed earlier in this batch, e.g. by the timer
+    HttpConn* conn = m_users[socketFd];
+    if (!conn)
+        return;
+    if (conn->readFromSocket())
+    {
+        conn->handleRequest(m_connPool);
+        adjustTimer(&conn->clientData.timer);
+        setIdle(&conn->clientData.timer, false);
+    }
+    else
+    {
+        closeConnection(socketFd);
+    }
+}
+
+void SubReactor::handleWrite(int socketFd)
+{
+    HttpConn* conn = m_users[socketFd];
+    if (!conn)
+        return;
+    bool requestBuffered;
+    bool idle;
+    if (conn->writeToSocket(requestBuffered, idle))
+    {
+        if (requestBuffered)
+            conn->handleRequest(m_connPool);
+        adjustTimer(&conn->clientData.timer);
+        setIdle(&conn->clientData.timer, idle);
+    }
+    else
+    {
+        closeConnection(socketFd);
+    }
+}
+
+void SubReactor::run()
+{
+    while (!m_stop)
+    {
+        int eventCount = epoll_wait(m_epollFd, m_events, MAX_EVENT_COUNT, -1);
+        if (eventCount < 0 && errno != EINTR)
+        {
+            LOG_ERROR(m_logStatus, "Sub-reactor %d epoll failure", m_id);
+            break;
+        }
+        m_utils.updateNow();
+
+        for (int i = 0; i < eventCount; ++i)
+        {
+            int socketFd = m_events[i].data.fd;
+
+            if (socketFd == m_wakeupFd)
+            {
+                acceptPending();
+            }
+            else if (socketFd == m_utils.m_timerFd)
+            {
+                // The fd may be disarmed (EPOLLONESHOT) and would never report a hang-up: close it here
+                m_utils.timerHandler(m_expiredFds);
+                for (size_t j = 0; j < m_expiredFds.size(); ++j)
+                    closeConnection(m_expiredFds[j]);
+            }
+            else if (m_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                closeConnection(socketFd);
+            }
+            else if (m_events[i].events & EPOLLIN)
+            {
+                handleRead(socketFd);
+            }
+            else if (m_events[i].events & EPOLLOUT)
+            {
+                handleWrite(socketFd);
+            }
+        }
+
+        m_utils.updateTimerFd();
+    }
+}
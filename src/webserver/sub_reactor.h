@@ -0,0 +1,81 @@
+#ifndef SUB_REACTOR_H
+#define SUB_REACTOR_H
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+#include <string>
+
+#include "../lock/locker.h"
+#include "../http/http_conn.h"
+#include "../memory/slab.h"
+#include "../timer/timer_list.h"
+
+// 从Reactor：拥有独立的epoll实例和时间轮，在单个线程内完成连接的读、解析和写
+// 主Reactor只负责accept，并通过dispatch将新连接交给某个从Reactor
+class SubReactor
+{
+public:
+    static const int MAX_EVENT_COUNT = 1024;
+
+public:
+    SubReactor();
+    ~SubReactor();
+
+    void init(int id, int maxFileDescriptors, char* rootDirectory, int connectionTriggerMode, int logStatus, int timeSlot,
+              int maxRequestSize, int sendFile, int cacheMaxAge, const char* uploadDirectory, long maxUploadSize,
+              int keepAliveTimeout, int maxKeepAliveRequests, ConnectionPool* connPool);
+    void start();
+    void stop();
+
+    // Called from the accept thread: queue the connection and wake the sub-reactor
+    bool dispatch(int connectionFd, const sockaddr_in& clientAddress);
+
+private:
+    static void* worker(void* arg);
+    void run();
+    void acceptPending();
+    void addTimer(int connectionFd, const sockaddr_in& clientAddress);
+    void adjustTimer(UtilTimer* timer);
+    void setIdle(UtilTimer* timer, bool idle);
+    void closeConnection(int socketFd);
+    void handleRead(int socketFd);
+    void handleWrite(int socketFd);
+
+private:
+    int m_id;
+    pthread_t m_thread;
+    bool m_started;
+    std::atomic<bool> m_stop;
+
+    int m_epollFd;
+    int m_wakeupFd;                 // eventfd used by the accept thread to signal new connections
+    epoll_event m_events[MAX_EVENT_COUNT];
+
+    Locker m_pendingLocker;         // 保护待接管连接队列
+    std::vector<std::pair<int, sockaddr_in> > m_pending;
+
+    // Shared fd-indexed table; each fd is only ever touched by the sub-reactor that owns it
+    HttpConn** m_users;             // fd-indexed, private to this thread
+    Slab<HttpConn> m_connectionSlab;    // Slots of the connections this sub-reactor owns
+    Utils m_utils;                  // Own timer wheel and timerfd
+    std::vector<int> m_expiredFds;  // Timed-out sockets of one tick
+
+    char* m_rootDirectory;
+    int m_connectionTriggerMode;
+    int m_logStatus;
+    int m_timeSlot;
+    int m_maxRequestSize;
+    int m_sendFile;
+    int m_cacheMaxAge;
+    const char* m_uploadDirectory;
+    long m_maxUploadSize;
+    int m_keepAliveTimeout;
+    int m_maxKeepAliveRequests;
+    ConnectionPool* m_connPool;
+};
+
+#endif
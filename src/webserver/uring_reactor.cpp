@@ -0,0 +1,410 @@
+#include "uring_reactor.h"
+
+UringReactor::UringReactor()
+    : m_stop(false)
+    , m_multishotRecv(true)
+    , m_listenFd(-1)
+    , m_signalFd(-1)
+    , m_maxConnections(0)
+    , m_states(nullptr)
+    , m_users(nullptr)
+    , m_connPool(nullptr)
+{
+}
+
+UringReactor::~UringReactor()
+{
+    delete[] m_states;
+}
+
+bool UringReactor::init(int listenFd, int signalFd, int maxConnections, HttpConn** users, char* rootDirectory,
+                        int logStatus, int timeSlot, int maxRequestSize, int cacheMaxAge,
+                        const char* uploadDirectory, long maxUploadSize, int keepAliveTimeout,
+                        int maxKeepAliveRequests, ConnectionPool* connPool)
+{
+    m_listenFd = listenFd;
+    m_signalFd = signalFd;
+    m_maxConnections = maxConnections;
+    m_users = users;
+    m_rootDirectory = rootDirectory;
+    m_logStatus = logStatus;
+    m_timeSlot = timeSlot;
+    m_maxRequestSize = maxRequestSize;
+    m_cacheMaxAge = cacheMaxAge;
+    m_uploadDirectory = uploadDirectory;
+    m_maxUploadSize = maxUploadSize;
+    m_keepAliveTimeout = keepAliveTimeout;
+    m_maxKeepAliveRequests = maxKeepAliveRequests;
+    m_connPool = connPool;
+
+    m_utils.init(timeSlot);
+
+    // Provided buffer rings (5.19+) imply multishot accept support as well
+    if (!m_ring.init(RING_ENTRIES) || !m_ring.setupBufferRing(BUFFER_GROUP, BUFFER_COUNT, BUFFER_SIZE))
+        return false;
+
+    m_states = new ConnectionState[m_maxConnections];
+    memset(m_states, 0, sizeof(ConnectionState) * m_maxConnections);
+    return true;
+}
+
+io_uring_sqe* UringReactor::getSqe()
+{
+    io_uring_sqe* sqe;
+    while (!(sqe = m_ring.getSqe()))
+    {
+        m_ring.submit();
+    }
+    return sqe;
+}
+
+void UringReactor::submitAccept()
+{
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listenFd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = encode(OP_ACCEPT, m_listenFd, 0);
+}
+
+void UringReactor::submitRecv(int fd)
+{
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    if (m_multishotRecv)
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = encode(OP_RECV, fd, m_states[fd].generation);
+}
+
+// 提交shutdown + close链，同一时刻每个fd最多只有一个close在途
+void UringReactor::submitClose(int fd)
+{
+    ConnectionState& state = m_states[fd];
+    if (state.closeQueued)
+        return;
+    state.closeQueued = true;
+
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_SHUTDOWN;
+    sqe->fd = fd;
+    sqe->len = SHUT_RDWR;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = encode(OP_SHUTDOWN, fd, state.generation);
+
+    sqe = getSqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = encode(OP_CLOSE, fd, state.generation);
+}
+
+// 提交writev；非长连接时链接shutdown/close，响应写完后由内核直接关闭连接
+// 若writev只写了一部分，链上的close会以-ECANCELED完成，随后重新提交剩余部分
+void UringReactor::submitWrite(int fd)
+{
+    ConnectionState& state = m_states[fd];
+    state.writing = true;
+
+    int iovCount = 0;
+    struct iovec* iov = m_users[fd]->getWriteIov(iovCount);
+
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)iov;
+    sqe->len = iovCount;
+    sqe->user_data = encode(OP_WRITE, fd, state.generation);
+
+    if (!m_users[fd]->isKeepAlive() && !state.closeQueued)
+    {
+        sqe->flags = IOSQE_IO_LINK;
+        state.closing = true;
+        submitClose(fd);
+    }
+}
+
+void UringReactor::submitSignalPoll()
+{
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = m_signalFd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = encode(OP_SIGNAL, m_signalFd, 0);
+}
+
+void UringReactor::submitTick()
+{
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = m_utils.m_timerFd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = encode(OP_TICK, m_utils.m_timerFd, 0);
+}
+
+void UringReactor::closeConnection(int fd)
+{
+    m_states[fd].closing = true;
+    submitClose(fd);
+}
+
+void UringReactor::handleAccept(io_uring_cqe* cqe)
+{
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+        submitAccept();
+
+    if (cqe->res < 0)
+    {
+        LOG_ERROR(m_logStatus, "%s: errno is %d", "Accept error", -cqe->res);
+        return;
+    }
+
+    int connectionFd = cqe->res;
+    if (connectionFd >= m_maxConnections || HttpConn::g_userCount >= m_maxConnections)
+    {
+        const char* info = "Internal server busy";
+        send(connectionFd, info, strlen(info), 0);
+        close(connectionFd);
+        LOG_ERROR(m_logStatus, "%s", info);
+        return;
+    }
+
+    struct sockaddr_in clientAddress;
+    socklen_t clientAddrLength = sizeof(clientAddress);
+    memset(&clientAddress, 0, sizeof(clientAddress));
+    getpeername(connectionFd, (struct sockaddr *)&clientAddress, &clientAddrLength);
+
+    ConnectionState& state = m_states[connectionFd];
+    state.writing = false;
+    state.closing = false;
+    state.closeQueued = false;
+
+    HttpConn* conn = m_connectionSlab.allocate();
+    m_users[connectionFd] = conn;
+    // The ring writes with writev, so file bodies stay mmap'd whatever -f says
+    conn->init(-1, connectionFd, clientAddress, m_rootDirectory, 0, m_logStatus, m_maxRequestSize, 0,
+               m_cacheMaxAge, m_uploadDirectory, m_maxUploadSize, m_keepAliveTimeout, m_maxKeepAliveRequests);
+
+    // 超时只关闭读写方向，由随后完成的recv走正常的关闭流程
+    conn->clientData.address = clientAddress;
+    conn->clientData.sockFd = connectionFd;
+    conn->clientData.lastActive = m_utils.m_now;
+    UtilTimer* timer = &conn->clientData.timer;
+    timer->userData = &conn->clientData;
+    timer->timeout = 3 * m_timeSlot * 1000;
+    timer->expire = m_utils.m_now + timer->timeout;
+    m_utils.m_timerList.addTimer(timer);
+
+    submitRecv(connectionFd);
+}
+
+void UringReactor::handleRequest(int fd)
+{
+    HttpConn::HttpCode result = m_users[fd]->prepareResponse(m_connPool);
+    if (result == HttpConn::NO_REQUEST)
+        return;
+    if (result == HttpConn::CLOSED_CONNECTION)
+    {
+        closeConnection(fd);
+        return;
+    }
+    submitWrite(fd);
+}
+
+void UringReactor::handleRecv(int fd, io_uring_cqe* cqe)
+{
+    ConnectionState& state = m_states[fd];
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+
+    if (cqe->res > 0)
+    {
+        unsigned short bufferId = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        bool appended = state.closing || m_users[fd]->appendReadData(m_ring.getBuffer(bufferId), cqe->res);
+        m_ring.recycleBuffer(bufferId);
+
+        if (state.closing)
+            return;
+        if (!appended)
+        {
+            closeConnection(fd);
+            return;
+        }
+
+        m_users[fd]->clientData.lastActive = m_utils.m_now;
+        setIdle(fd, false);
+
+        // A response still in flight is finished first; its completion picks up the new data
+        if (!state.writing)
+            handleRequest(fd);
+        if (!more && !state.closing)
+            submitRecv(fd);
+        return;
+    }
+
+    if (state.closing)
+        return;
+
+    if (cqe->res == -ENOBUFS)
+    {
+        submitRecv(fd);
+    }
+    else if (cqe->res == -EINVAL && m_multishotRecv)
+    {
+        // Multishot recv needs 6.0+, fall back to one receive per submission
+        m_multishotRecv = false;
+        submitRecv(fd);
+    }
+    else
+    {
+        closeConnection(fd);
+    }
+}
+
+void UringReactor::handleWrite(int fd, io_uring_cqe* cqe)
+{
+    ConnectionState& state = m_states[fd];
+
+    if (cqe->res < 0)
+    {
+        state.writing = false;
+        closeConnection(fd);
+        return;
+    }
+
+    if (!m_users[fd]->advanceWrite(cqe->res))
+    {
+        // Short write: wait for the cancelled close chain before resubmitting
+        if (!state.closeQueued)
+            submitWrite(fd);
+        return;
+    }
+
+    state.writing = false;
+    if (m_users[fd]->finishResponse())
+    {
+        handleRequest(fd);
+        if (!state.writing && !state.closing && m_users[fd]->isIdle())
+        {
+            m_users[fd]->clientData.lastActive = m_utils.m_now;
+            setIdle(fd, true);
+        }
+    }
+}
+
+// 请求之间的空闲连接按keep-alive超时关闭，请求进行中按请求超时
+void UringReactor::setIdle(int fd, bool idle)
+{
+    m_utils.m_timerList.setTimeout(&m_users[fd]->clientData.timer,
+                                   idle ? m_keepAliveTimeout * 1000 : 3 * m_timeSlot * 1000);
+}
+
+void UringReactor::handleClose(int fd)
+{
+    HttpConn* conn = m_users[fd];
+    m_utils.m_timerList.deleteTimer(&conn->clientData.timer);
+    m_users[fd] = nullptr;
+    m_connectionSlab.release(conn);
+
+    ConnectionState& state = m_states[fd];
+    ++state.generation;
+    state.writing = false;
+    state.closing = false;
+    state.closeQueued = false;
+    -- HttpConn::g_userCount;
+
+    LOG_INFO(m_logStatus, "Closed socket %d", fd);
+}
+
+bool UringReactor::handleSignal()
+{
+    struct signalfd_siginfo info;
+    while (read(m_signalFd, &info, sizeof(info)) == sizeof(info))
+    {
+        if (info.ssi_signo == SIGTERM)
+            return false;
+    }
+    return true;
+}
+
+void UringReactor::run()
+{
+    submitAccept();
+    submitSignalPoll();
+    submitTick();
+
+    while (!m_stop)
+    {
+        int ret = m_ring.submitAndWait(1);
+        if (ret < 0 && ret != -EINTR)
+        {
+            LOG_ERROR(m_logStatus, "%s", "io_uring failure");
+            break;
+        }
+        m_utils.updateNow();
+
+        io_uring_cqe* cqe;
+        while ((cqe = m_ring.peekCqe()) != nullptr)
+        {
+            Operation op = (Operation)(cqe->user_data >> 56);
+            unsigned generation = (cqe->user_data >> 32) & 0xffffff;
+            int fd = (int)(cqe->user_data & 0xffffffff);
+
+            // Completions for an fd that has since been closed only need their buffer returned
+            bool stale = (op == OP_RECV || op == OP_WRITE || op == OP_CLOSE)
+                         && generation != (m_states[fd].generation & 0xffffff);
+            if (stale)
+            {
+                if (cqe->flags & IORING_CQE_F_BUFFER)
+                    m_ring.recycleBuffer(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                m_ring.cqeSeen();
+                continue;
+            }
+
+            switch (op)
+            {
+            case OP_ACCEPT:
+                handleAccept(cqe);
+                break;
+            case OP_RECV:
+                handleRecv(fd, cqe);
+                break;
+            case OP_WRITE:
+                handleWrite(fd, cqe);
+                break;
+            case OP_CLOSE:
+                if (cqe->res == -ECANCELED)
+                {
+                    // The linked writev was short or failed: continue writing or close for real
+                    m_states[fd].closeQueued = false;
+                    if (m_states[fd].writing)
+                        submitWrite(fd);
+                    else
+                        submitClose(fd);
+                }
+                else
+                {
+                    handleClose(fd);
+                }
+                break;
+            case OP_SIGNAL:
+                if (!handleSignal())
+                    m_stop = true;
+                submitSignalPoll();
+                break;
+            case OP_TICK:
+                m_utils.timerHandler(m_expiredFds);
+                for (size_t j = 0; j < m_expiredFds.size(); ++j)
+                    closeConnection(m_expiredFds[j]);
+                submitTick();
+                break;
+            default:
+                break;
+            }
+            m_ring.cqeSeen();
+        }
+
+        m_utils.updateTimerFd();
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef URING_REACTOR_H
+#define URING_REACTOR_H
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <string>
+
+#include "../uring/io_uring.h"
+#include "../http/http_conn.h"
+#include "../memory/slab.h"
+#include "../timer/timer_list.h"
+
+// io_uring事件循环：multishot accept + provided buffer recv + writev/shutdown/close链式提交
+// 信号和定时器分别通过signalfd、timerfd的poll请求接入
+// 所有连接在循环线程内完成读、解析和写，完成事件直接驱动HttpConn的状态
+class UringReactor
+{
+public:
+    static const unsigned RING_ENTRIES = 4096;
+    static const unsigned BUFFER_COUNT = 4096;      // Must be a power of two
+    static const unsigned BUFFER_SIZE = 2048;
+    static const unsigned short BUFFER_GROUP = 0;
+
+public:
+    UringReactor();
+    ~UringReactor();
+
+    // Returns false if io_uring (or multishot/provided buffers) is unavailable, so the caller can fall back to epoll
+    bool init(int listenFd, int signalFd, int maxConnections, HttpConn** users, char* rootDirectory, int logStatus,
+              int timeSlot, int maxRequestSize, int cacheMaxAge, const char* uploadDirectory, long maxUploadSize,
+              int keepAliveTimeout, int maxKeepAliveRequests, ConnectionPool* connPool);
+    void run();
+
+private:
+    enum Operation
+    {
+        OP_ACCEPT = 1,
+        OP_RECV,
+        OP_WRITE,
+        OP_SHUTDOWN,
+        OP_CLOSE,
+        OP_SIGNAL,
+        OP_TICK
+    };
+
+    // Per-fd bookkeeping; the generation tells completions of a closed fd apart from its reuse
+    struct ConnectionState
+    {
+        unsigned generation;
+        bool writing;       // A writev for the current response has not finished yet
+        bool closing;       // The connection is being torn down
+        bool closeQueued;   // A shutdown/close chain has been submitted and not completed
+    };
+
+    static uint64_t encode(Operation op, int fd, unsigned generation)
+    {
+        return ((uint64_t)op << 56) | ((uint64_t)(generation & 0xffffff) << 32) | (uint32_t)fd;
+    }
+
+    io_uring_sqe* getSqe();
+    void submitAccept();
+    void submitRecv(int fd);
+    void submitWrite(int fd);
+    void submitClose(int fd);
+    void submitSignalPoll();
+    void submitTick();
+    void closeConnection(int fd);
+
+    void handleAccept(io_uring_cqe* cqe);
+    void handleRecv(int fd, io_uring_cqe* cqe);
+    void handleWrite(int fd, io_uring_cqe* cqe);
+    void handleClose(int fd);
+    void handleRequest(int fd);
+    void setIdle(int fd, bool idle);
+    bool handleSignal();
+
+private:
+    IoUring m_ring;
+    bool m_stop;
+    bool m_multishotRecv;
+
+    int m_listenFd;
+    int m_signalFd;
+    int m_maxConnections;
+    ConnectionState* m_states;
+
+    HttpConn** m_users;
+    Slab<HttpConn> m_connectionSlab;
+    Utils m_utils;                  // Timer wheel plus the timerfd polled through the ring
+    std::vector<int> m_expiredFds;  // Timed-out sockets of one tick
+
+    char* m_rootDirectory;
+    int m_logStatus;
+    int m_timeSlot;
+    int m_maxRequestSize;
+    int m_cacheMaxAge;
+    const char* m_uploadDirectory;
+    long m_maxUploadSize;
+    int m_keepAliveTimeout;
+    int m_maxKeepAliveRequests;
+    ConnectionPool* m_connPool;
+};
+
+#endif
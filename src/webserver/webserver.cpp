@@ -1,9 +1,18 @@
 #include "webserver.h"
+#include "../http/http_scanner.h"
 
 WebServer::WebServer()
+    : m_threadPool(nullptr)
+    , m_blockingPool(nullptr)
+    , m_taskSequence(0)
+    , m_subReactors(nullptr)
+    , m_subReactorCount(0)
+    , m_nextSubReactor(0)
 {
-    // Initialize HTTP connection objects
-    m_users = new HttpConn[MAX_FILE_DESCRIPTORS];
+    // fd-indexed connection table; slots are allocated from a slab on accept
+    m_users = new HttpConn*[MAX_FILE_DESCRIPTORS]();
+    m_pendingTasks.reserve(MAX_EVENT_COUNT);
+    m_pendingBlocking.reserve(MAX_EVENT_COUNT);
 
     // Root directory path
     char serverPath[200];
@@ -14,24 +23,28 @@ WebServer::WebServer()
     strcpy(m_rootDirectory, serverPath);
     strcat(m_rootDirectory, rootDirectory);
 
-    // Initialize timers
-    m_userTimers = new ClientData[MAX_FILE_DESCRIPTORS];
+    // Uploads are staged outside the document root so they are never served back
+    m_uploadDirectory = std::string(serverPath) + "/../upload";
 }
 
 WebServer::~WebServer()
 {
+    delete[] m_subReactors;
     close(m_epollFd);
     close(m_listenFd);
-    close(m_pipeFds[1]);
-    close(m_pipeFds[0]);
+    close(m_signalFd);
     delete[] m_users;
-    delete[] m_userTimers;
     delete m_threadPool;
+    delete m_blockingPool;
+    free(m_rootDirectory);
 }
 
 void WebServer::init(int port, const std::string& user, const std::string& password, const std::string& databaseName,
                            int logWriteMethod, int enableLinger, int triggerMode, int sqlConnectionPoolSize,
-                           int threadPoolSize, int logStatus, int actorModel)
+                           int threadPoolSize, int logStatus, int actorModel, int subReactorCount, int ioBackend,
+                           int maxRequestSize, int sendFile, int fileCacheSize, int cacheMaxAge, long maxUploadSize,
+                           const std::string& uploadDirectory, int keepAliveTimeout, int maxKeepAliveRequests,
+                           int scheduleMode, int staticQueueLimit, int blockingThreads, int blockingQueueLimit)
 {
     m_port = port;
     m_databaseUser = user;
@@ -44,6 +57,29 @@ void WebServer::init(int port, const std::string& user, const std::string& passw
     m_triggerMode = triggerMode;
     m_logStatus = logStatus;
     m_actorModel = actorModel;
+    m_subReactorCount = subReactorCount;
+    m_ioBackend = ioBackend;
+    m_sendFile = sendFile;
+    m_fileCacheSize = fileCacheSize < 0 ? 0 : fileCacheSize;
+    m_cacheMaxAge = cacheMaxAge < 0 ? 0 : cacheMaxAge;
+    m_maxUploadSize = maxUploadSize < 0 ? 0 : maxUploadSize;
+    if (!uploadDirectory.empty())
+        m_uploadDirectory = uploadDirectory;
+    m_keepAliveTimeout = keepAliveTimeout < 1 ? 1 : keepAliveTimeout;
+    m_maxKeepAliveRequests = maxKeepAliveRequests < 0 ? 0 : maxKeepAliveRequests;
+    m_scheduleMode = scheduleMode == SCHEDULE_STEALING ? SCHEDULE_STEALING : SCHEDULE_SHARED;
+    m_staticQueueLimit = staticQueueLimit < 1 ? 1 : staticQueueLimit;
+    m_blockingThreads = blockingThreads < 0 ? 0 : blockingThreads;
+    m_blockingQueueLimit = blockingQueueLimit < 1 ? 1 : blockingQueueLimit;
+
+    // The read buffer grows through the pool's size classes, so the largest class caps the ceiling
+    m_maxRequestSize = maxRequestSize;
+    if (m_maxRequestSize < HttpConn::READ_BUFFER_SIZE)
+        m_maxRequestSize = HttpConn::READ_BUFFER_SIZE;
+    if (m_maxRequestSize > BufferPool::maxBufferSize() - 1)
+        m_maxRequestSize = BufferPool::maxBufferSize() - 1;
+
+    HttpConn::initResponses();
 }
 
 
@@ -73,6 +109,22 @@ void WebServer::configureTriggerMode()
 }
 
 
+// 屏蔽SIGTERM/SIGHUP并改由signalfd接收，须在创建任何线程之前调用，使所有线程继承该屏蔽字
+void WebServer::setupSignals()
+{
+    m_utils.addSignal(SIGPIPE, SIG_IGN);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    int ret = pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    assert(ret == 0);
+
+    m_signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    assert(m_signalFd != -1);
+}
+
 void WebServer::setupLogging()
 {
     if (m_logStatus == 0)
@@ -83,6 +135,22 @@ void WebServer::setupLogging()
         else
             Log::getInstance()->init("./ServerLog", m_logStatus, 2000, 800000, 0);
     }
+    LOG_INFO(m_logStatus, "request scanner: %s", scannerName());
+}
+void WebServer::setupFileCache()
+{
+    FileCache::getInstance()->init(m_rootDirectory, m_fileCacheSize, m_cacheMaxAge, m_logStatus);
+}
+// 暂存目录不存在时创建，无法创建则关闭上传
+void WebServer::setupUploads()
+{
+    if (m_maxUploadSize == 0)
+        return;
+    if (mkdir(m_uploadDirectory.c_str(), 0700) == -1 && errno != EEXIST)
+    {
+        LOG_ERROR(m_logStatus, "upload directory %s: %s, uploads disabled", m_uploadDirectory.c_str(), strerror(errno));
+        m_maxUploadSize = 0;
+    }
 }
 void WebServer::setupDatabaseConnectionPool()
 {
@@ -91,13 +159,49 @@ void WebServer::setupDatabaseConnectionPool()
     m_connectionPool->init("localhost", m_databaseUser, m_databasePassword, m_databaseName, 3306, m_sqlConnectionPoolSize, m_logStatus);
 
     // Initialize database result table
-    m_users->initMysqlResult(m_connectionPool);
+    HttpConn::initMysqlResult(m_connectionPool, m_logStatus);
 }
 
 void WebServer::setupThreadPool()
 {
+    // Sub-reactors handle requests on their own threads, no worker pool needed
+    if (m_actorModel == 2)
+        return;
+
     // Initialize thread pool
-    m_threadPool = new ThreadPool<HttpConn>(m_actorModel, m_connectionPool, m_threadPoolSize);
+    m_threadPool = new ThreadPool<HttpConn>(m_actorModel, m_connectionPool, &m_completionQueue, m_scheduleMode,
+                                            LANE_STATIC, m_threadPoolSize, m_staticQueueLimit);
+
+    // Database-bound handlers get their own lane so a slow database does not hold up static responses
+    if (m_blockingThreads > 0)
+    {
+        m_blockingPool = new ThreadPool<HttpConn>(m_actorModel, m_connectionPool, &m_completionQueue, SCHEDULE_SHARED,
+                                                  LANE_BLOCKING, m_blockingThreads, m_blockingQueueLimit);
+        // In reactor mode the request is only read on a worker, which routes it once the request line is in
+        if (m_actorModel == 1)
+            m_threadPool->setBlockingLane(m_blockingPool);
+    }
+}
+
+void WebServer::setupSubReactors()
+{
+    if (m_actorModel != 2)
+        return;
+
+    // Default to one sub-reactor per online core
+    if (m_subReactorCount <= 0)
+        m_subReactorCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (m_subReactorCount <= 0)
+        m_subReactorCount = 1;
+
+    m_subReactors = new SubReactor[m_subReactorCount];
+    for (int i = 0; i < m_subReactorCount; ++i)
+    {
+        m_subReactors[i].init(i, MAX_FILE_DESCRIPTORS, m_rootDirectory, m_connectionTriggerMode, m_logStatus, TIME_SLOT,
+                              m_maxRequestSize, m_sendFile, m_cacheMaxAge, m_uploadDirectory.c_str(),
+                              m_maxUploadSize, m_keepAliveTimeout, m_maxKeepAliveRequests, m_connectionPool);
+        m_subReactors[i].start();
+    }
 }
 
 
@@ -131,62 +235,90 @@ void WebServer::startListening()
     assert(m_epollFd != -1);
 
     m_utils.addFd(m_epollFd, m_listenFd, false, m_listenTriggerMode);
-    HttpConn::g_epollFd = m_epollFd;
 
-    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipeFds);
-    assert(ret != -1);
-    m_utils.setNonBlocking(m_pipeFds[1]);
-    m_utils.addFd(m_epollFd, m_pipeFds[0], false, 0);
-
-    m_utils.addSignal(SIGPIPE, SIG_IGN);
-    m_utils.addSignal(SIGALRM, m_utils.signalHandler, false);
-    m_utils.addSignal(SIGTERM, m_utils.signalHandler, false);
+    // Signals and timer deadlines are delivered as readable fds in the same epoll set
+    m_utils.addFd(m_epollFd, m_signalFd, false, 0);
+    m_utils.addFd(m_epollFd, m_utils.m_timerFd, false, 0);
 
-    alarm(TIME_SLOT);
+    // Workers report their outcomes through the completion eventfd: read/write results in reactor mode, and in
+    // both modes when they let go of the connection
+    if (m_actorModel != 2)
+        m_utils.addFd(m_epollFd, m_completionQueue.getEventFd(), false, 0);
+}
 
-    // Initialize utility class for signal and file descriptor operations
-    Utils::u_pipeFds = m_pipeFds;
-    Utils::u_epollFd = m_epollFd;
+// 主从Reactor模式下，主线程只负责accept，新连接按轮询交给从Reactor
+void WebServer::dispatchConnection(int connectionFd, const struct sockaddr_in& clientAddress)
+{
+    if (m_actorModel == 2)
+    {
+        m_subReactors[m_nextSubReactor].dispatch(connectionFd, clientAddress);
+        m_nextSubReactor = (m_nextSubReactor + 1) % m_subReactorCount;
+        return;
+    }
+    addTimer(connectionFd, clientAddress);
 }
 
 
 void WebServer::addTimer(int connectionFd, const struct sockaddr_in& clientAddress)
 {
-    m_users[connectionFd].init(connectionFd, clientAddress, m_rootDirectory, m_connectionTriggerMode, m_logStatus, m_databaseUser, m_databasePassword, m_databaseName);
-
-    // Initialize client data and create timer
-    m_userTimers[connectionFd].address = clientAddress;
-    m_userTimers[connectionFd].sockFd = connectionFd;
-    UtilTimer* timer = new UtilTimer;
-    timer->userData = &m_userTimers[connectionFd];
-    timer->callback = callback;
-    time_t currentTime = time(nullptr);
-    timer->expire = currentTime + 3 * TIME_SLOT;
-    m_userTimers[connectionFd].timer = timer;
+    HttpConn* conn = m_connectionSlab.allocate();
+    m_users[connectionFd] = conn;
+    conn->init(m_epollFd, connectionFd, clientAddress, m_rootDirectory, m_connectionTriggerMode, m_logStatus,
+               m_maxRequestSize, m_sendFile, m_cacheMaxAge, m_uploadDirectory.c_str(), m_maxUploadSize,
+               m_keepAliveTimeout, m_maxKeepAliveRequests);
+
+    // Initialize client data and its inline timer
+    conn->clientData.address = clientAddress;
+    conn->clientData.sockFd = connectionFd;
+    conn->clientData.lastActive = m_utils.m_now;
+    UtilTimer* timer = &conn->clientData.timer;
+    timer->userData = &conn->clientData;
+    timer->timeout = 3 * TIME_SLOT * 1000;
+    timer->expire = m_utils.m_now + timer->timeout;
     m_utils.m_timerList.addTimer(timer);
 }
 
-// 若有数据传输，则将定时器往后延迟3个单位
-// 并对新的定时器在链表上的位置进行调整
+// 若有数据传输，只记录本轮循环的时间，不移动定时器
+// 到期时由时间轮检查该时间并将定时器往后顺延
 void WebServer::adjustTimer(UtilTimer* timer)
 {
-    time_t currentTime = time(nullptr);
-    timer->expire = currentTime + 3 * TIME_SLOT;
-    m_utils.m_timerList.adjustTimer(timer);
+    timer->userData->lastActive = m_utils.m_now;
+}
 
-    LOG_INFO(m_logStatus, "%s", "Timer adjusted");
+// 请求之间的空闲连接按keep-alive超时关闭，请求进行中按请求超时
+void WebServer::setIdle(UtilTimer* timer, bool idle)
+{
+    m_utils.m_timerList.setTimeout(timer, idle ? m_keepAliveTimeout * 1000 : 3 * TIME_SLOT * 1000);
 }
 
 
-void WebServer::handleTimer(UtilTimer* timer, int socketFd)
+// 关闭连接：摘除定时器，移出epoll并关闭fd，连接槽位归还slab
+// 连接仍在工作线程手中时只shutdown，等它的完成结果到达再真正关闭
+void WebServer::closeConnection(int socketFd)
 {
-    timer->callback(&m_userTimers[socketFd]);
-    if (timer)
+    HttpConn* conn = m_users[socketFd];
+    if (!conn)
+        return;
+    if (conn->inFlight)
     {
-        m_utils.m_timerList.deleteTimer(timer);
+        // The worker's reads and writes fail from now on; the fd number stays taken until the completion
+        if (!conn->closePending)
+        {
+            shutdown(socketFd, SHUT_RDWR);
+            conn->closePending = true;
+        }
+        return;
     }
 
-    LOG_INFO(m_logStatus, "Closed socket %d", m_userTimers[socketFd].sockFd);
+    m_utils.m_timerList.deleteTimer(&conn->clientData.timer);
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, socketFd, 0);
+    close(socketFd);
+    -- HttpConn::g_userCount;
+
+    m_users[socketFd] = nullptr;
+    m_connectionSlab.release(conn);
+
+    LOG_INFO(m_logStatus, "Closed socket %d", socketFd);
 }
 
 
@@ -208,7 +340,7 @@ bool WebServer::handleClientData()
             LOG_ERROR(m_logStatus, "%s", "Internal server busy");
             return false;
         }
-        addTimer(connectionFd, clientAddress);
+        dispatchConnection(connectionFd, clientAddress);
     }
     else
     {
@@ -226,138 +358,212 @@ bool WebServer::handleClientData()
                 LOG_ERROR(m_logStatus, "%s", "Internal server busy");
                 break;
             }
-            addTimer(connectionFd, clientAddress);
+            dispatchConnection(connectionFd, clientAddress);
         }
         return false;
     }
     return true;
 }
 
-bool WebServer::handleSignals(bool& timeout, bool& stopServer)
+bool WebServer::handleSignals(bool& stopServer)
 {
-    int ret = 0;
-    int signal;
-    char signals[1024];
-    ret = recv(m_pipeFds[0], signals, sizeof(signals), 0);
-    if (ret == -1)
-    {
-        return false;
-    }
-    else if (ret == 0)
-    {
-        return false;
-    }
-    else
+    struct signalfd_siginfo info;
+    bool received = false;
+    while (read(m_signalFd, &info, sizeof(info)) == sizeof(info))
     {
-        for (int i = 0; i < ret; ++i)
+        received = true;
+        switch (info.ssi_signo)
         {
-            switch (signals[i])
-            {
-                case SIGALRM:
-                    timeout = true;
-                    break;
-                case SIGTERM:
-                    stopServer = true;
-                    break;
-                default:
-                    break;
-            }
+            case SIGTERM:
+                stopServer = true;
+                break;
+            case SIGHUP:
+                // Logged (and flushed) so an external log rotation sees a complete file
+                LOG_INFO(m_logStatus, "%s", "SIGHUP received");
+                break;
+            default:
+                break;
         }
     }
-    return true;
+    return received;
 }
 
 
 void WebServer::handleRead(int socketFd)
 {
-    UtilTimer* timer = m_userTimers[socketFd].timer;
+    // Closed earlier in this batch, e.g. by the timer, or waiting for its worker to finish before closing
+    HttpConn* conn = m_users[socketFd];
+    if (!conn || conn->closePending)
+        return;
+    UtilTimer* timer = &conn->clientData.timer;
 
     if (m_actorModel == 1)
     {
-        if (timer)
-        {
-            adjustTimer(timer);
-        }
-
-        m_threadPool->append(m_users + socketFd, 0);
+        adjustTimer(timer);
+        setIdle(timer, false);
 
-        while (true)
-        {
-            if (m_users[socketFd].isImproved == 1)
-            {
-                if (m_users[socketFd].timerFlag == 1)
-                {
-                    handleTimer(timer, socketFd);
-                    m_users[socketFd].timerFlag = 0;
-                }
-                m_users[socketFd].isImproved = 0;
-                break;
-            }
-        }
+        // The outcome comes back through handleCompletions
+        conn->requestState = 0;
+        stageTask(conn);
     }
     else
     {
-        if (m_users[socketFd].readFromSocket())
+        if (conn->readFromSocket())
         {
-            LOG_INFO(m_logStatus, "deal with the client(%s)", inet_ntoa(m_users[socketFd].getAddress()->sin_addr));
-            m_threadPool->appendP(m_users + socketFd);
+            LOG_INFO(m_logStatus, "deal with the client(%s)", inet_ntoa(conn->getAddress()->sin_addr));
+            stageTask(conn);
             
-            if (timer)
-            {
-                adjustTimer(timer);
-            }
+            adjustTimer(timer);
+            setIdle(timer, false);
         }
         else
         {
-            handleTimer(timer, socketFd);
+            closeConnection(socketFd);
         }
     }
 }
 
 void WebServer::handleWrite(int socketFd)
 {
-    UtilTimer* timer = m_userTimers[socketFd].timer;
+    HttpConn* conn = m_users[socketFd];
+    if (!conn || conn->closePending)
+        return;
+    UtilTimer* timer = &conn->clientData.timer;
     if (m_actorModel == 1)
     {
-        if (timer)
+        adjustTimer(timer);
+        conn->requestState = 1;
+        stageTask(conn);
+    }
+    else
+    {
+        bool requestBuffered;
+        bool idle;
+        if (conn->writeToSocket(requestBuffered, idle))
         {
+            LOG_INFO(m_logStatus, "Data sent to client %s", inet_ntoa(conn->getAddress()->sin_addr));
+            // Pipelined request already in the read buffer: hand it to a worker as if it had just been read
+            if (requestBuffered)
+                stageTask(conn);
             adjustTimer(timer);
+            setIdle(timer, idle);
         }
-        m_threadPool->append(m_users + socketFd, 1);
-        while (true)
+        else
         {
-            if (m_users[socketFd].isImproved == 1)
-            {
-                if (m_users[socketFd].timerFlag == 1)
-                {
-                    handleTimer(timer, socketFd);
-                    m_users[socketFd].timerFlag = 0;
-                }
-                m_users[socketFd].isImproved = 0;
-                break;
-            }
+            closeConnection(socketFd);
         }
     }
-    else
+}
+
+// 处理工作线程回报的结果：失败的连接在事件循环线程中关闭
+void WebServer::handleCompletions()
+{
+    m_completionQueue.drain(m_completions);
+    for (size_t i = 0; i < m_completions.size(); ++i)
     {
-        if (m_users[socketFd].writeToSocket())
+        int socketFd = m_completions[i].sockFd;
+        HttpConn* conn = m_users[socketFd];
+        // Stale: the loop has staged another task on the connection since (a request that arrived after the
+        // worker re-armed the socket), or the fd was closed and now belongs to a new connection
+        if (!conn || conn->taskSequence != m_completions[i].sequence)
+            continue;
+        if (!finishTask(conn))
+            continue;
+        if (!m_completions[i].keepConnection)
         {
-            LOG_INFO(m_logStatus, "Data sent to client %s", inet_ntoa(m_users[socketFd].getAddress()->sin_addr));
-            if (timer)
-            {
-                adjustTimer(timer);
-            }
+            closeConnection(socketFd);
         }
-        else
+        else if (m_completions[i].idle)
         {
-            handleTimer(timer, socketFd);
+            setIdle(&conn->clientData.timer, true);
         }
     }
 }
 
+// io_uring后端：所有连接在主线程内由完成事件驱动，不再经过epoll和线程池
+bool WebServer::startUringLoop()
+{
+    UringReactor reactor;
+    if (!reactor.init(m_listenFd, m_signalFd, MAX_FILE_DESCRIPTORS, m_users, m_rootDirectory, m_logStatus,
+                      TIME_SLOT, m_maxRequestSize, m_cacheMaxAge, m_uploadDirectory.c_str(), m_maxUploadSize,
+                      m_keepAliveTimeout, m_maxKeepAliveRequests, m_connectionPool))
+    {
+        LOG_WARN(m_logStatus, "%s", "io_uring unavailable, falling back to epoll");
+        return false;
+    }
+
+    LOG_INFO(m_logStatus, "%s", "Using io_uring backend");
+    reactor.run();
+    return true;
+}
+
+// Proactor mode: the request is already read, its request line decides the lane
+// Reactor mode: the static lane reads it and hands a register on itself
+void WebServer::stageTask(HttpConn* conn)
+{
+    // Workers echo the sequence in their completion, which tells a result for an earlier task apart
+    conn->taskSequence = ++m_taskSequence;
+    conn->inFlight = true;
+    if (m_actorModel != 1 && m_blockingPool && conn->needsBlockingLane())
+        m_pendingBlocking.push_back(conn);
+    else
+        m_pendingTasks.push_back(conn);
+}
+
+// 连接的任务已结束（完成或未能入队），回到事件循环手中；期间被关闭的连接此时才真正关闭
+// Returns false when it was closed
+bool WebServer::finishTask(HttpConn* conn)
+{
+    conn->inFlight = false;
+    if (!conn->closePending)
+        return true;
+    closeConnection(conn->getSocketFd());
+    return false;
+}
+
+// 本轮epoll_wait收集到的请求一次性交给线程池
+void WebServer::submitPendingTasks()
+{
+    submitLane(m_threadPool, m_pendingTasks);
+    if (m_blockingPool)
+        submitLane(m_blockingPool, m_pendingBlocking);
+}
+
+void WebServer::submitLane(ThreadPool<HttpConn>* lane, std::vector<HttpConn*>& tasks)
+{
+    if (tasks.empty())
+        return;
+    int queued = lane->appendBatch(tasks.data(), (int)tasks.size());
+    if (queued < (int)tasks.size() && m_actorModel == 1)
+    {
+        // Nothing was read or written yet: the rest stays staged, in order, with its socket disarmed
+        // (EPOLLONESHOT) and is submitted again after the next epoll_wait. The queue is full, so completions
+        // of queued tasks are on their way and wake the loop once a worker has taken one
+        tasks.erase(tasks.begin(), tasks.begin() + queued);
+        return;
+    }
+    if (queued < (int)tasks.size())
+    {
+        LOG_WARN(m_logStatus, "%s lane full, %d requests not queued", lane == m_blockingPool ? "blocking" : "static",
+                 (int)tasks.size() - queued);
+        // A request that was read can still be turned away
+        for (size_t i = queued; i < tasks.size(); ++i)
+        {
+            if (!finishTask(tasks[i]))
+                continue;
+            Metrics::getInstance()->add(lane == m_blockingPool ? METRIC_LANE_BLOCKING_REJECTED
+                                                               : METRIC_LANE_STATIC_REJECTED);
+            tasks[i]->rejectRequest();
+        }
+    }
+    tasks.clear();
+}
+
 void WebServer::startEventLoop()
 {
-    bool timeout = false;
+    if (m_ioBackend == 1 && startUringLoop())
+        return;
+
     bool stopServer = false;
     while (!stopServer)
     {
@@ -367,6 +573,7 @@ void WebServer::startEventLoop()
             LOG_ERROR(m_logStatus, "%s", "Epoll failure");
             break;
         }
+        m_utils.updateNow();
 
         for (int i = 0; i < eventCount; ++i)
         {
@@ -378,17 +585,27 @@ void WebServer::startEventLoop()
                 if (!success)
                     continue;
             }
+            else if (socketFd == m_completionQueue.getEventFd())
+            {
+                handleCompletions();
+            }
             else if (m_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
             {
-                UtilTimer* timer = m_userTimers[socketFd].timer;
-                handleTimer(timer, socketFd);
+                closeConnection(socketFd);
             }
-            else if ((socketFd == m_pipeFds[0]) && (m_events[i].events & EPOLLIN))
+            else if ((socketFd == m_signalFd) && (m_events[i].events & EPOLLIN))
             {
-                bool success = handleSignals(timeout, stopServer);
+                bool success = handleSignals(stopServer);
                 if (!success)
                     continue;
             }
+            else if ((socketFd == m_utils.m_timerFd) && (m_events[i].events & EPOLLIN))
+            {
+                // The fd may be disarmed (EPOLLONESHOT) and would never report a hang-up: close it here
+                m_utils.timerHandler(m_expiredFds);
+                for (size_t j = 0; j < m_expiredFds.size(); ++j)
+                    closeConnection(m_expiredFds[j]);
+            }
             else if (m_events[i].events & EPOLLIN)
             {
                 handleRead(socketFd);
@@ -398,11 +615,8 @@ void WebServer::startEventLoop()
                 handleWrite(socketFd);
             }
         }
-        if (timeout)
-        {
-            m_utils.timerHandler();
-            LOG_INFO(m_logStatus, "%s", "Timer tick");
-            timeout = false;
-        }
+        submitPendingTasks();
+        // New or adjusted timers may need the timerfd to fire earlier
+        m_utils.updateTimerFd();
     }
 }
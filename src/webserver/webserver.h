@@ -11,13 +11,17 @@
 #include <stdlib.h>
 #include <cassert>
 #include <sys/epoll.h>
+#include <sys/signalfd.h>
 
 #include "../threadpool/threadpool.h"
 #include "../http/http_conn.h"
+#include "../memory/slab.h"
+#include "sub_reactor.h"
+#include "uring_reactor.h"
 
 const int MAX_FILE_DESCRIPTORS = 65536;  // 最大文件描述符
 const int MAX_EVENT_COUNT = 10000;       // 最大事件数
-const int TIME_SLOT = 5;                 // 最小超时单位
+const int TIME_SLOT = 5;                 // 超时单位（秒），请求在3个单位内没有进展时关闭连接
 
 class WebServer
 {
@@ -27,21 +31,36 @@ public:
 
     void init(int port, const std::string& user, const std::string& password, const std::string& databaseName,
               int logWriteMethod, int enableLinger, int triggerMode, int sqlConnectionPoolSize,
-              int threadPoolSize, int logStatus, int actorModel);
+              int threadPoolSize, int logStatus, int actorModel, int subReactorCount, int ioBackend,
+              int maxRequestSize, int sendFile, int fileCacheSize, int cacheMaxAge, long maxUploadSize,
+              const std::string& uploadDirectory, int keepAliveTimeout, int maxKeepAliveRequests,
+              int scheduleMode, int staticQueueLimit, int blockingThreads, int blockingQueueLimit);
 
+    void setupSignals();
     void setupThreadPool();
+    void setupSubReactors();
     void setupDatabaseConnectionPool();
     void setupLogging();
+    void setupFileCache();
+    void setupUploads();
     void configureTriggerMode();
     void startListening();
     void startEventLoop();
+    bool startUringLoop();
+    void dispatchConnection(int connectionFd, const struct sockaddr_in& clientAddress);
     void addTimer(int connectionFd, const struct sockaddr_in& clientAddress);
     void adjustTimer(UtilTimer* timer);
-    void handleTimer(UtilTimer* timer, int socketFd);
+    void setIdle(UtilTimer* timer, bool idle);
+    void closeConnection(int socketFd);
     bool handleClientData();
-    bool handleSignals(bool& timeout, bool& stopServer);
+    bool handleSignals(bool& stopServer);
+    void handleCompletions();
     void handleRead(int socketFd);
     void handleWrite(int socketFd);
+    void stageTask(HttpConn* conn);
+    bool finishTask(HttpConn* conn);
+    void submitPendingTasks();
+    void submitLane(ThreadPool<HttpConn>* lane, std::vector<HttpConn*>& tasks);
 
 public:
     int m_port;
@@ -49,10 +68,20 @@ public:
     int m_logWriteMethod;
     int m_logStatus;
     int m_actorModel;
+    int m_ioBackend;        // 0: epoll, 1: io_uring (falls back to epoll when unavailable)
+    int m_maxRequestSize;   // Per-request read buffer ceiling in bytes
+    int m_sendFile;         // 1: file bodies via sendfile, 0: mmap + writev
+    int m_fileCacheSize;    // Static file cache budget in bytes, 0 disables it
+    int m_cacheMaxAge;      // Cache-Control max-age of static files in seconds
+    long m_maxUploadSize;   // Largest POST /upload body in bytes, 0 disables uploads
+    std::string m_uploadDirectory;  // Where uploaded files are staged
+    int m_keepAliveTimeout;         // Seconds a connection may sit idle between requests
+    int m_maxKeepAliveRequests;     // Requests per connection, 0 for no limit
 
-    int m_pipeFds[2];
+    int m_signalFd;
     int m_epollFd;
-    HttpConn* m_users;
+    HttpConn** m_users;                 // Indexed by fd, nullptr when the fd has no open connection
+    Slab<HttpConn> m_connectionSlab;    // Connection slots of the main event loop
 
     // Database
     ConnectionPool* m_connectionPool;
@@ -65,6 +94,22 @@ public:
     // Thread pool
     ThreadPool<HttpConn>* m_threadPool;
     int m_threadPoolSize;
+    int m_scheduleMode;                         // ScheduleMode of the worker pool
+    int m_staticQueueLimit;
+    ThreadPool<HttpConn>* m_blockingPool;       // Lane for database-bound handlers, null when disabled
+    int m_blockingThreads;
+    int m_blockingQueueLimit;
+    CompletionQueue m_completionQueue;          // Worker results, and the end of every pool task
+    std::vector<Completion> m_completions;
+    unsigned int m_taskSequence;                // Last HttpConn::taskSequence handed out
+    std::vector<HttpConn*> m_pendingTasks;      // Requests gathered from one epoll_wait, submitted together;
+                                                // in reactor mode also those a full lane could not take yet
+    std::vector<HttpConn*> m_pendingBlocking;   // The same for the blocking lane
+
+    // Sub-reactors (actorModel == 2)
+    SubReactor* m_subReactors;
+    int m_subReactorCount;
+    int m_nextSubReactor;
 
     // epoll_event
     epoll_event m_events[MAX_EVENT_COUNT];
@@ -76,7 +121,7 @@ public:
     int m_connectionTriggerMode;
 
     // Timer
-    ClientData* m_userTimers;
     Utils m_utils;
+    std::vector<int> m_expiredFds;              // Timed-out sockets of one tick
 };
 #endif